@@ -0,0 +1,315 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "inputscript.h"
+#include "workpool.h"
+
+constexpr uint32_t default_ipf = 11;
+constexpr const char* load_error = "ROM could not be loaded";
+
+struct Job {
+    std::string rom;
+    std::string input;              //empty for no input script
+    uint64_t cycles;
+    const std::vector<uint8_t>* image;
+    const std::vector<InputEvent>* events;
+};
+
+struct JobResult {
+    bool loaded = false;            //false if the ROM could not be loaded
+    double seconds = 0;
+    uint64_t framebuffer_hash = 0;
+    Chip8Registers registers{};
+};
+
+static bool parse_backend(const char* name, Backend& backend){
+    if (strcmp(name, "interpreter") == 0) backend = Backend::Interpreter;
+    else if (strcmp(name, "blocks") == 0) backend = Backend::Blocks;
+    else if (strcmp(name, "jit") == 0) backend = Backend::Jit;
+    else return false;
+    return true;
+}
+
+static bool read_file(const std::string& path, std::vector<uint8_t>& data){
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open ROM file " << path << std::endl;
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/**
+ * Reads a manifest of jobs, one per line as tab-separated
+ * "<rom> <input script> <cycles>", with - for no input script. Relative
+ * paths are resolved against the manifest's directory; blank lines and
+ * lines starting with # are skipped.
+ */
+static bool load_manifest(const char* path, std::vector<Job>& jobs){
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open manifest " << path << std::endl;
+        return false;
+    }
+    std::filesystem::path base = std::filesystem::path(path).parent_path();
+    auto resolve = [&base](const std::string& name){
+        std::filesystem::path file_path(name);
+        return (file_path.is_absolute() ? file_path : base / file_path).string();
+    };
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string rom, input, cycles;
+        std::getline(fields, rom, '\t');
+        std::getline(fields, input, '\t');
+        std::getline(fields, cycles, '\t');
+        char* end = nullptr;
+        uint64_t count = strtoull(cycles.c_str(), &end, 10);
+        if (rom.empty() || input.empty() || cycles.empty() || *end) {
+            std::cerr << path << ":" << number << ": expected \"<rom>\\t<input script>\\t<cycles>\"" << std::endl;
+            return false;
+        }
+        jobs.push_back({resolve(rom), input == "-" ? std::string() : resolve(input), count, nullptr, nullptr});
+    }
+    return true;
+}
+
+// Parses a whole unsigned decimal argument, rejecting signs, trailing text and overflow.
+static bool parse_number(const char* text, uint64_t max, uint64_t& value){
+    char* end = nullptr;
+    errno = 0;
+    value = strtoull(text, &end, 10);
+    return text[0] >= '0' && text[0] <= '9' && !*end && errno == 0 && value <= max;
+}
+
+static std::string hex(uint64_t value, int width){
+    std::ostringstream text;
+    text << std::hex << std::setfill('0') << std::setw(width) << value;
+    return text.str();
+}
+
+static std::string hex_registers(const uint8_t (&V)[16]){
+    std::string text;
+    for (uint8_t value : V) {
+        text += hex(value, 2);
+    }
+    return text;
+}
+
+static std::string csv_quote(const std::string& text){
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string json_quote(const std::string& text){
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void write_csv(std::ostream& out, const std::vector<Job>& jobs, const std::vector<JobResult>& results){
+    out << "rom,input,cycles,seconds,cycles_per_second,framebuffer_hash,pc,i,sp,delay_timer,sound_timer,v,error\n";
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const JobResult& result = results[i];
+        const Chip8Registers& registers = result.registers;
+        out << csv_quote(jobs[i].rom) << "," << csv_quote(jobs[i].input) << "," << jobs[i].cycles << ",";
+        if (!result.loaded) {
+            out << ",,,,,,,,," << csv_quote(load_error) << "\n";
+            continue;
+        }
+        out << result.seconds << "," << (result.seconds > 0 ? jobs[i].cycles / result.seconds : 0) << ","
+            << hex(result.framebuffer_hash, 16) << "," << hex(registers.pc, 3) << "," << hex(registers.I, 3) << ","
+            << static_cast<int>(registers.sp) << "," << static_cast<int>(registers.delay_timer) << ","
+            << static_cast<int>(registers.sound_timer) << "," << hex_registers(registers.V) << ",\n";
+    }
+}
+
+static void write_jsonl(std::ostream& out, const std::vector<Job>& jobs, const std::vector<JobResult>& results){
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const JobResult& result = results[i];
+        const Chip8Registers& registers = result.registers;
+        out << "{\"rom\":" << json_quote(jobs[i].rom) << ",\"input\":" << json_quote(jobs[i].input)
+            << ",\"cycles\":" << jobs[i].cycles;
+        if (!result.loaded) {
+            out << ",\"error\":" << json_quote(load_error) << "}\n";
+            continue;
+        }
+        out << ",\"seconds\":" << result.seconds
+            << ",\"cycles_per_second\":" << (result.seconds > 0 ? jobs[i].cycles / result.seconds : 0)
+            << ",\"framebuffer_hash\":\"" << hex(result.framebuffer_hash, 16) << "\""
+            << ",\"pc\":" << registers.pc << ",\"i\":" << registers.I << ",\"sp\":" << static_cast<int>(registers.sp)
+            << ",\"delay_timer\":" << static_cast<int>(registers.delay_timer)
+            << ",\"sound_timer\":" << static_cast<int>(registers.sound_timer)
+            << ",\"v\":\"" << hex_registers(registers.V) << "\"}\n";
+    }
+}
+
+static void usage(const char* name){
+    std::cerr << "Usage: " << name << " [--threads N] [--ipf N] [--seed N] [--backend interpreter|blocks|jit]"
+              << " [--format csv|jsonl] [--output path] <manifest>" << std::endl;
+}
+
+/**
+ * Runs every job of a manifest headless on all cores and writes one result
+ * per job, in manifest order.
+ *
+ * Each worker thread keeps one Chip8 instance and reuses it for every job
+ * it runs; ROM images and input scripts are read once up front.
+ */
+int main(int argc, char* argv[]){
+    const char* manifest_path = nullptr;
+    const char* output_path = nullptr;
+    bool jsonl = false;
+    unsigned threads = 0;
+    uint32_t ipf = default_ipf;
+    uint64_t seed = 0;
+    Backend backend = Backend::Interpreter;
+    for (int i = 1; i < argc; ++i) {
+        bool ok = true;
+        uint64_t value = 0;
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], std::numeric_limits<unsigned>::max(), value) && value > 0;
+            threads = static_cast<unsigned>(value);
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], std::numeric_limits<uint32_t>::max(), value) && value > 0;
+            ipf = static_cast<uint32_t>(value);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], std::numeric_limits<uint64_t>::max(), seed);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            ok = parse_backend(argv[++i], backend);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            ++i;
+            jsonl = strcmp(argv[i], "jsonl") == 0;
+            ok = jsonl || strcmp(argv[i], "csv") == 0;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (!manifest_path) {
+            manifest_path = argv[i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!manifest_path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<Job> jobs;
+    if (!load_manifest(manifest_path, jobs))
+        return 1;
+    std::map<std::string, std::vector<uint8_t>> images;
+    std::map<std::string, std::vector<InputEvent>> scripts;
+    static const std::vector<InputEvent> no_events;
+    for (Job& job : jobs) {
+        auto image = images.find(job.rom);
+        if (image == images.end()) {
+            image = images.emplace(job.rom, std::vector<uint8_t>()).first;
+            if (!read_file(job.rom, image->second))
+                return 1;
+        }
+        job.image = &image->second;
+        job.events = &no_events;
+        if (!job.input.empty()) {
+            auto script = scripts.find(job.input);
+            if (script == scripts.end()) {
+                script = scripts.emplace(job.input, std::vector<InputEvent>()).first;
+                if (!load_input_script(job.input.c_str(), script->second))
+                    return 1;
+            }
+            job.events = &script->second;
+        }
+    }
+
+    WorkStealingPool pool(threads);
+    std::vector<std::unique_ptr<Chip8>> machines;
+    for (unsigned i = 0; i < pool.size(); ++i) {
+        machines.push_back(std::make_unique<Chip8>());
+        if (!machines.back()->set_backend(backend))
+            return 1;
+    }
+
+    std::vector<JobResult> results(jobs.size());
+    auto start = std::chrono::steady_clock::now();
+    pool.run(jobs.size(), [&](std::size_t index, unsigned worker){
+        const Job& job = jobs[index];
+        Chip8& chip8 = *machines[worker];
+        JobResult& result = results[index];
+        chip8.seed(seed);
+        chip8.reset();
+        if (!chip8.loadROM(job.image->data(), job.image->size())) {
+            std::cerr << "Failed to load " << job.rom << std::endl;
+            return;
+        }
+        result.loaded = true;
+        auto job_start = std::chrono::steady_clock::now();
+        run_scripted(chip8, *job.events, job.cycles, ipf);
+        auto job_end = std::chrono::steady_clock::now();
+        result.seconds = std::chrono::duration<double>(job_end - job_start).count();
+        result.framebuffer_hash = chip8.framebuffer_hash();
+        result.registers = chip8.registers();
+    });
+    auto end = std::chrono::steady_clock::now();
+
+    std::ofstream file;
+    if (output_path) {
+        file.open(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open output file " << output_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = output_path ? file : std::cout;
+    if (jsonl) {
+        write_jsonl(out, jobs, results);
+    } else {
+        write_csv(out, jobs, results);
+    }
+
+    uint64_t total_cycles = 0;
+    std::size_t failed = 0;
+    for (std::size_t index = 0; index < jobs.size(); ++index) {
+        if (results[index].loaded)
+            total_cycles += jobs[index].cycles;
+        else
+            ++failed;
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::cerr << std::dec << jobs.size() << " jobs on " << pool.size() << " threads in " << seconds << " s, "
+              << (seconds > 0 ? total_cycles / seconds / 1e6 : 0) << " M cycles/s" << std::endl;
+    if (failed) {
+        std::cerr << failed << " jobs failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
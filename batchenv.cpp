@@ -0,0 +1,108 @@
+#include "batchenv.h"
+
+#include <cstring>
+
+BatchEnv::BatchEnv(std::size_t count, unsigned threads): seeds(count), pool(threads){
+    for (std::size_t env = 0; env < count; ++env) {
+        envs.push_back(std::make_unique<Chip8>());
+    }
+}
+
+BatchEnv::~BatchEnv() = default;
+
+std::size_t BatchEnv::size() const{
+    return envs.size();
+}
+
+/**
+ * Sets the ROM the environments run. It takes effect at the next reset.
+ */
+bool BatchEnv::loadROM(const uint8_t* data, std::size_t size){
+    if (size > mem_size - start_addr) {
+        std::cerr << "ROM file is too large." << std::endl;
+        return false;
+    }
+    rom.assign(data, data + size);
+    return true;
+}
+
+// Instructions each environment runs per frame, before its timer tick; at least 1.
+bool BatchEnv::set_ipf(uint32_t ipf){
+    if (ipf == 0)
+        return false;
+    this->ipf = ipf;
+    return true;
+}
+
+// Fails, leaving every environment on its backend, if this build lacks it.
+bool BatchEnv::set_backend(Backend backend){
+    for (auto& env : envs) {
+        if (!env->set_backend(backend))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Restarts every environment from a freshly loaded ROM. Environment i
+ * draws its random numbers from the seed seed + i.
+ */
+void BatchEnv::reset(uint64_t seed){
+    pool.run(envs.size(), [&](std::size_t env, unsigned){
+        Chip8& chip8 = *envs[env];
+        seeds[env] = seed + env;
+        chip8.seed(seeds[env]);
+        chip8.reset();
+        chip8.loadROM(rom.data(), rom.size());
+    });
+}
+
+/**
+ * Holds the keys of each environment's action for the given number of
+ * frames, each one ipf instructions followed by a timer tick.
+ */
+void BatchEnv::step(const uint16_t* actions, uint32_t frames){
+    pool.run(envs.size(), [&](std::size_t env, unsigned){
+        Chip8& chip8 = *envs[env];
+        for (int key = 0; key < 16; ++key) {
+            chip8.keypad[key] = (actions[env] >> key) & 1;
+        }
+        for (uint32_t frame = 0; frame < frames; ++frame) {
+            chip8.run(ipf);
+            chip8.update_timers();
+        }
+    });
+}
+
+/**
+ * Writes the framebuffer of every environment to out, one after another,
+ * observation_size(format) bytes each.
+ */
+void BatchEnv::observe(uint8_t* out, ObservationFormat format){
+    std::size_t stride = observation_size(format);
+    pool.run(envs.size(), [&](std::size_t env, unsigned){
+        const Chip8& chip8 = *envs[env];
+        uint8_t* observation = out + env * stride;
+        if (format == ObservationFormat::Bits) {
+            memcpy(observation, chip8.display, sizeof(chip8.display));
+            return;
+        }
+        for (int y = 0; y < display_rows; ++y) {
+            for (int x = 0; x < display_width; ++x) {
+                observation[y * display_width + x] = (chip8.display[y] >> (63 - x)) & 1;
+            }
+        }
+    });
+}
+
+std::size_t BatchEnv::observation_size(ObservationFormat format){
+    return format == ObservationFormat::Bits ? display_rows * sizeof(uint64_t) : display_width * display_rows;
+}
+
+Chip8Registers BatchEnv::registers(std::size_t env) const{
+    return envs[env]->registers();
+}
+
+uint64_t BatchEnv::seed(std::size_t env) const{
+    return seeds[env];
+}
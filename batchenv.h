@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chip8.h"
+#include "workpool.h"
+
+// Layouts BatchEnv::observe can write a framebuffer in.
+enum class ObservationFormat {
+    Bits,   //display_rows 64-bit words per environment, as Chip8::display
+    Bytes   //64 x 32 bytes per environment, row-major, 1 for a lit pixel
+};
+
+/**
+ * A batch of Chip8 environments running the same ROM, for reinforcement
+ * learning.
+ *
+ * Actions are keypad states, one 16-bit mask per environment with bit k
+ * set while key k is held. step and observe spread the environments over
+ * a work-stealing thread pool; observe writes straight into a contiguous
+ * caller buffer of observation_size bytes per environment.
+ */
+class BatchEnv {
+public:
+    explicit BatchEnv(std::size_t count, unsigned threads = 0);
+    ~BatchEnv();
+    BatchEnv(const BatchEnv&) = delete;
+    BatchEnv& operator=(const BatchEnv&) = delete;
+
+    std::size_t size() const;
+    bool loadROM(const uint8_t* data, std::size_t size);
+    bool set_ipf(uint32_t ipf);
+    bool set_backend(Backend backend);
+
+    void reset(uint64_t seed);
+    void step(const uint16_t* actions, uint32_t frames);
+    void observe(uint8_t* out, ObservationFormat format);
+    static std::size_t observation_size(ObservationFormat format);
+
+    Chip8Registers registers(std::size_t env) const;
+    uint64_t seed(std::size_t env) const;
+private:
+    std::vector<std::unique_ptr<Chip8>> envs;
+    std::vector<uint64_t> seeds;
+    std::vector<uint8_t> rom;
+    uint32_t ipf = 11;
+    WorkStealingPool pool;
+};
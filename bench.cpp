@@ -0,0 +1,286 @@
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "lockstep.h"
+#include "pixelexpander.h"
+
+constexpr uint32_t bench_cycles = 1000000;
+constexpr uint32_t bench_frames = 100000;
+constexpr std::size_t bench_lanes = 256;
+constexpr uint32_t bench_lockstep_cycles = 20000;
+constexpr uint32_t micro_cycles = 2000000;
+constexpr uint16_t micro_loop_end = 0xFFA;   //the loop jump goes before here
+constexpr uint16_t micro_tail_addr = 0xFFC;  //subroutines called by a stream
+
+struct BenchResult {
+    double seconds = 0;
+    uint64_t instructions = 0;
+};
+
+// A synthetic instruction stream exercising one class of instructions.
+struct MicroBench {
+    const char* name;
+    std::vector<uint16_t> prologue;     //run once, to set up registers
+    std::vector<uint16_t> pattern;      //repeated up to micro_loop_end, then looped
+    std::vector<uint16_t> tail;         //placed at micro_tail_addr
+};
+
+// Results of one microbenchmark, in instructions per second.
+struct MicroResult {
+    const char* name;
+    double emulate_cycle = 0;
+    double run = 0;
+};
+
+static const std::vector<MicroBench> micro_benches = {
+    //every 8xyN ALU operation
+    {"alu_8xyn", {0x6003, 0x6155, 0x62A7, 0x630F},
+     {0x8010, 0x8121, 0x8232, 0x8303, 0x8014, 0x8125, 0x8236, 0x8307, 0x801E}, {}},
+    //5-row font sprites at two positions
+    {"draw_dxyn", {0x6000, 0x6108, 0x6220, 0x6310, 0xA050}, {0xD015, 0xD235}, {}},
+    //16-register stores and loads below the program, I reset before each
+    {"block_fx55_fx65", {}, {0xA100, 0xFF55, 0xA100, 0xFF65}, {}},
+    //a call to a subroutine that returns right away
+    {"call_ret", {}, {0x2000 | micro_tail_addr}, {0x00EE}},
+};
+
+/**
+ * Runs a ROM for bench_cycles cycles, calling step the given number of times,
+ * and accumulates the elapsed time into result.
+ */
+template <typename Step>
+static void bench_rom(const std::string& path, Step step, BenchResult& result,
+                      uint32_t steps = bench_cycles){
+    Chip8 chip8;
+    if (!chip8.loadROM(path.c_str()))
+        return;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < steps; ++i) {
+        step(chip8);
+    }
+    auto end = std::chrono::steady_clock::now();
+    result.seconds += std::chrono::duration<double>(end - start).count();
+    result.instructions += bench_cycles;
+}
+
+static double ips(const BenchResult& result){
+    return result.seconds > 0 ? result.instructions / result.seconds : 0;
+}
+
+/**
+ * Lays out a microbenchmark as a ROM image: the prologue, then the pattern
+ * repeated as often as it fits, a jump back to the first repetition and the
+ * tail at micro_tail_addr.
+ */
+static std::vector<uint8_t> micro_image(const MicroBench& bench){
+    std::vector<uint16_t> words(bench.prologue);
+    uint16_t loop = start_addr + 2 * words.size();
+    while (start_addr + 2 * (words.size() + bench.pattern.size()) <= micro_loop_end) {
+        words.insert(words.end(), bench.pattern.begin(), bench.pattern.end());
+    }
+    words.push_back(0x1000 | loop);
+    words.resize((micro_tail_addr - start_addr) / 2, 0);
+    words.insert(words.end(), bench.tail.begin(), bench.tail.end());
+    std::vector<uint8_t> image;
+    for (uint16_t word : words) {
+        image.push_back(word >> 8);
+        image.push_back(word & 0xFF);
+    }
+    return image;
+}
+
+/**
+ * Times micro_cycles instructions of a synthetic stream, once through
+ * Chip8::emulateCycle and once through Chip8::run.
+ */
+static MicroResult bench_micro(const MicroBench& bench){
+    std::vector<uint8_t> image = micro_image(bench);
+    MicroResult result{bench.name};
+    for (int pass = 0; pass < 2; ++pass) {
+        Chip8 chip8;
+        chip8.loadROM(image.data(), image.size());
+        auto start = std::chrono::steady_clock::now();
+        if (pass == 0) {
+            for (uint32_t i = 0; i < micro_cycles; ++i) {
+                chip8.emulateCycle();
+            }
+        } else {
+            chip8.run(micro_cycles);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        (pass == 0 ? result.emulate_cycle : result.run) = seconds > 0 ? micro_cycles / seconds : 0;
+    }
+    return result;
+}
+
+/**
+ * Times bench_frames calls of a pixel expansion kernel and returns the
+ * frames per second.
+ */
+template <typename Expand>
+static double bench_expand(Expand expand){
+    static uint32_t out[frame_width * frame_height];
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < bench_frames; ++i) {
+        expand(out);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return seconds > 0 ? bench_frames / seconds : 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string roms_dir = "roms/chip8-roms-master";
+    const char* json_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            roms_dir = argv[i];
+        }
+    }
+
+    std::vector<std::string> roms;
+    std::error_code ec;
+    for (auto& entry : std::filesystem::recursive_directory_iterator(roms_dir, ec)) {
+        if (entry.path().extension() == ".ch8")
+            roms.push_back(entry.path().string());
+    }
+    if (roms.empty()) {
+        std::cerr << "No ROMs found in " << roms_dir << std::endl;
+        return 1;
+    }
+
+    std::vector<MicroResult> micro_results;
+    for (const MicroBench& bench : micro_benches) {
+        micro_results.push_back(bench_micro(bench));
+        const MicroResult& result = micro_results.back();
+        std::cout << "micro " << result.name << ": " << result.emulate_cycle / 1e6 << " M instructions/s emulateCycle, "
+                  << result.run / 1e6 << " M instructions/s run" << std::endl;
+    }
+
+    //profiling and non-x86-64 builds lack some backends; those report 0
+    Chip8 probe;
+    bool blocks_available = probe.set_backend(Backend::Blocks);
+    bool jit_available = probe.set_backend(Backend::Jit);
+
+    BenchResult switch_total, table_total, run_total, blocks_total, jit_total;
+    for (auto& rom : roms) {
+        bench_rom(rom, [](Chip8& c){ c.emulateCycleSwitch(); }, switch_total);
+        bench_rom(rom, [](Chip8& c){ c.emulateCycle(); }, table_total);
+        bench_rom(rom, [](Chip8& c){ c.run(bench_cycles); }, run_total, 1);
+        if (blocks_available) {
+            bench_rom(rom, [](Chip8& c){
+                c.set_backend(Backend::Blocks);
+                c.run(bench_cycles);
+            }, blocks_total, 1);
+        }
+        if (jit_available) {
+            bench_rom(rom, [](Chip8& c){
+                c.set_backend(Backend::Jit);
+                c.run(bench_cycles);
+            }, jit_total, 1);
+        }
+    }
+
+    std::cout << "ROMs:   " << roms.size() << " x " << bench_cycles << " cycles" << std::endl;
+    std::cout << "switch: " << ips(switch_total) / 1e6 << " M instructions/s" << std::endl;
+    std::cout << "cached: " << ips(table_total) / 1e6 << " M instructions/s" << std::endl;
+    std::cout << "run:    " << ips(run_total) / 1e6 << " M instructions/s" << std::endl;
+    std::cout << "blocks: " << ips(blocks_total) / 1e6 << " M instructions/s" << std::endl;
+    std::cout << "jit:    " << ips(jit_total) / 1e6 << " M instructions/s" << std::endl;
+
+    //check the JIT against the reference decoder on every ROM
+    uint64_t mismatches = 0;
+    if (jit_available) {
+        for (auto& rom : roms) {
+            Chip8 chip8;
+            if (!chip8.loadROM(rom.c_str()))
+                continue;
+            chip8.set_backend(Backend::Jit);
+            chip8.set_jit_verify(true);
+            chip8.run(bench_cycles / 10);
+            mismatches += chip8.jit_mismatches();
+        }
+        std::cout << "jit verify: " << mismatches << " mismatches" << std::endl;
+    }
+
+    //lockstep lanes, all running the same ROM with no input
+    BenchResult lockstep_total;
+    double utilization = 0;
+    const char* kernels = "";
+    for (auto& rom : roms) {
+        std::ifstream file(rom, std::ios::binary);
+        std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        LockstepEngine engine(bench_lanes);
+        if (!engine.loadROM(image.data(), image.size()))
+            continue;
+        auto start = std::chrono::steady_clock::now();
+        engine.run(bench_lockstep_cycles);
+        auto end = std::chrono::steady_clock::now();
+        lockstep_total.seconds += std::chrono::duration<double>(end - start).count();
+        lockstep_total.instructions += uint64_t(bench_lockstep_cycles) * bench_lanes;
+        utilization += engine.stats().lane_utilization;
+        kernels = engine.kernel_name();
+    }
+    std::cout << "lockstep " << kernels << ": " << ips(lockstep_total) / 1e6 << " M lane instructions/s, "
+              << bench_lanes << " lanes, " << utilization / roms.size() * 100 << "% lane utilization" << std::endl;
+
+    //framebuffer to ARGB expansion, on a checkerboard frame
+    uint64_t rows[frame_height];
+    uint8_t bytes[frame_width * frame_height];
+    for (int y = 0; y < frame_height; ++y) {
+        rows[y] = (y & 1) ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull;
+        for (int x = 0; x < frame_width; ++x) {
+            bytes[y * frame_width + x] = (rows[y] >> (63 - x)) & 1;
+        }
+    }
+    std::vector<std::pair<const char*, std::pair<double, double>>> expand_results;
+    for (const PixelExpander& expander : supported_pixel_expanders()) {
+        double rows_fps = bench_expand([&](uint32_t* out){
+            expander.expand_rows(rows, frame_height, out, frame_width * sizeof(uint32_t), palette_classic);
+        });
+        double bytes_fps = bench_expand([&](uint32_t* out){
+            expander.expand_bytes(bytes, frame_height, out, frame_width * sizeof(uint32_t), palette_classic);
+        });
+        std::cout << "expand " << expander.name << ": " << rows_fps / 1e6 << " M frames/s packed, "
+                  << bytes_fps / 1e6 << " M frames/s bytes" << std::endl;
+        expand_results.push_back({expander.name, {rows_fps, bytes_fps}});
+    }
+
+    //machine-readable copy of the results, to track regressions
+    if (json_path) {
+        std::ofstream json(json_path);
+        json << "{\n  \"roms\": " << roms.size() << ",\n  \"cycles_per_rom\": " << bench_cycles << ",\n";
+        json << "  \"micro\": {";
+        for (std::size_t i = 0; i < micro_results.size(); ++i) {
+            json << (i ? ",\n" : "\n") << "    \"" << micro_results[i].name << "\": {\"emulate_cycle_mips\": "
+                 << micro_results[i].emulate_cycle / 1e6 << ", \"run_mips\": " << micro_results[i].run / 1e6 << "}";
+        }
+        json << "\n  },\n  \"rom_mips\": {\"switch\": " << ips(switch_total) / 1e6
+             << ", \"cached\": " << ips(table_total) / 1e6 << ", \"run\": " << ips(run_total) / 1e6
+             << ", \"blocks\": " << ips(blocks_total) / 1e6 << ", \"jit\": " << ips(jit_total) / 1e6 << "},\n";
+        json << "  \"jit_mismatches\": " << mismatches << ",\n";
+        json << "  \"lockstep\": {\"kernel\": \"" << kernels << "\", \"lanes\": " << bench_lanes
+             << ", \"lane_mips\": " << ips(lockstep_total) / 1e6
+             << ", \"lane_utilization\": " << utilization / roms.size() << "},\n";
+        json << "  \"expand_mfps\": {";
+        for (std::size_t i = 0; i < expand_results.size(); ++i) {
+            json << (i ? ", " : "") << "\"" << expand_results[i].first << "\": {\"packed\": "
+                 << expand_results[i].second.first / 1e6 << ", \"bytes\": " << expand_results[i].second.second / 1e6 << "}";
+        }
+        json << "}\n}\n";
+        if (!json) {
+            std::cerr << "Failed to write " << json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "blockcache.h"
+
+#include <algorithm>
+
+/**
+ * Returns true for instructions that can change pc or write memory.
+ *
+ * A block always ends after such an instruction, so every block either
+ * falls through to a single address or transfers control, and a store can
+ * never overwrite an instruction later in the block that is executing it.
+ */
+static bool ends_block(Op op){
+    switch (op)
+    {
+        case Op::RET:
+        case Op::JP:
+        case Op::CALL:
+        case Op::SE_BYTE:
+        case Op::SNE_BYTE:
+        case Op::SE_REG:
+        case Op::SNE_REG:
+        case Op::JP_V0:
+        case Op::SKP:
+        case Op::SKNP:
+        case Op::LD_VX_K:
+        case Op::LD_B:
+        case Op::LD_MEM_VX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Translates the instructions starting at start into a new block and
+ * registers it with the pages it spans.
+ */
+Block* Chip8::translate_block(uint16_t start){
+    auto block = std::make_unique<Block>();
+    block->start = start;
+
+    uint32_t addr = start;
+    while (true) {
+        uint16_t word = (memory[addr & mem_mask] << 8) | memory[(addr + 1) & mem_mask];
+        Instruction instruction = decode(word);
+        block->ops.push_back({op_handlers[static_cast<uint8_t>(instruction.op)], instruction});
+        addr += 2;
+        if (ends_block(instruction.op) || block->ops.size() == block_max_length || addr >= mem_size)
+            break;
+    }
+    block->end = std::min<uint32_t>(addr, mem_size);
+
+    for (uint16_t page = start / block_page_size; page <= (block->end - 1) / block_page_size; ++page) {
+        block_cache->page_blocks[page].push_back(start);
+    }
+    block_cache->blocks[start] = std::move(block);
+    return block_cache->blocks[start].get();
+}
+
+/**
+ * Returns the block starting at addr, translating it on first use.
+ */
+inline Block* Chip8::lookup_block(uint16_t addr){
+    Block* block = block_cache->blocks[addr & mem_mask].get();
+    return block ? block : translate_block(addr & mem_mask);
+}
+
+/**
+ * Invalidates the translated blocks overlapping the given memory range.
+ *
+ * Invalidated blocks are moved to the retired list rather than freed, since
+ * the block performing the write may still be executing. All chain links are
+ * dropped, so no block can reach a retired one.
+ */
+void Chip8::invalidate_blocks(uint16_t addr, uint16_t len){
+    BlockCache& cache = *block_cache;
+    bool invalidated = false;
+    for (uint16_t i = 0; i < len; ++i) {
+        uint16_t written = (addr + i) & mem_mask;
+        std::vector<uint16_t>& starts = cache.page_blocks[written / block_page_size];
+        for (size_t k = 0; k < starts.size();) {
+            Block* block = cache.blocks[starts[k]].get();
+            if (written < block->start || written >= block->end) {
+                ++k;
+                continue;
+            }
+            for (uint16_t page = block->start / block_page_size; page <= (block->end - 1) / block_page_size; ++page) {
+                auto& list = cache.page_blocks[page];
+                list.erase(std::find(list.begin(), list.end(), block->start));
+            }
+            cache.retired.push_back(std::move(cache.blocks[block->start]));
+            invalidated = true;
+        }
+    }
+    if (invalidated) {
+        cache.flushed = true;
+        for (auto& block : cache.blocks) {
+            if (block) {
+                block->next[0] = block->next[1] = nullptr;
+            }
+        }
+    }
+}
+
+void Chip8::flush_blocks(){
+    for (auto& block : block_cache->blocks) {
+        block.reset();
+    }
+    for (auto& starts : block_cache->page_blocks) {
+        starts.clear();
+    }
+}
+
+/**
+ * Emulates the given number of cycles by executing whole translated blocks.
+ *
+ * After a block finishes, the successor for the new pc is taken from the
+ * block's chain links, which are filled on first use and cache up to two
+ * targets, so steady-state loops never go through the block lookup. Cycles
+ * left over that are fewer than the next block's length are emulated one
+ * instruction at a time.
+ */
+void Chip8::run_blocks(uint32_t cycles){
+    BlockCache& cache = *block_cache;
+    cache.retired.clear();
+
+    Block* block = lookup_block(pc);
+    while (block->ops.size() <= cycles) {
+        cache.flushed = false;
+        for (const MicroOp& op : block->ops) {
+            pc += 2;
+            op.handler(*this, op.instruction);
+        }
+        cycles -= block->ops.size();
+
+        if (cache.flushed) {
+            cache.retired.clear();
+            block = lookup_block(pc);
+            continue;
+        }
+
+        Block* next = nullptr;
+        for (int k = 0; k < 2; ++k) {
+            if (block->next[k] && block->next_pc[k] == pc) {
+                next = block->next[k];
+                break;
+            }
+        }
+        if (!next) {
+            next = lookup_block(pc);
+            int slot = block->next[0] ? 1 : 0;
+            block->next[slot] = next;
+            block->next_pc[slot] = pc;
+        }
+        block = next;
+    }
+
+    while (cycles--) {
+        emulateCycle();
+    }
+}
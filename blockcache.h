@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "chip8.h"
+
+constexpr uint16_t block_page_size = 256;   //granularity of the write invalidation index
+constexpr uint16_t block_max_length = 64;   //instructions per block
+constexpr uint16_t block_pages = mem_size / block_page_size;
+
+// One pre-decoded instruction of a translated block.
+struct MicroOp {
+    void (*handler)(Chip8&, const Instruction&);
+    Instruction instruction;
+};
+
+// A straight-line run of instructions ending at a control transfer.
+struct Block {
+    uint16_t start;              //address of the first instruction
+    uint16_t end;                //address past the last instruction
+    std::vector<MicroOp> ops;
+    Block* next[2] = {};         //chained successors
+    uint16_t next_pc[2] = {};    //pc each successor was linked for
+};
+
+struct BlockCache {
+    std::unique_ptr<Block> blocks[mem_size];           //indexed by start address
+    std::vector<uint16_t> page_blocks[block_pages];    //starts of the blocks overlapping each page
+    std::vector<std::unique_ptr<Block>> retired;       //invalidated blocks, freed between blocks
+    bool flushed = false;                              //set when a block was invalidated
+};
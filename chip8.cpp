@@ -1,15 +1,74 @@
 #include "chip8.h"
+#include "blockcache.h"
+#include "crc32.h"
+#include "jit.h"
+#include "profiler.h"
+
+#include <chrono>
+
+namespace {
+
+constexpr uint8_t state_magic[4] = {'C', '8', 'S', 'T'};
+
+template <typename T>
+void put_le(uint8_t*& out, T value){
+    for (std::size_t byte = 0; byte < sizeof(T); ++byte) {
+        *out++ = static_cast<uint8_t>(value >> (8 * byte));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t*& in){
+    T value = 0;
+    for (std::size_t byte = 0; byte < sizeof(T); ++byte) {
+        value |= static_cast<T>(*in++) << (8 * byte);
+    }
+    return value;
+}
+
+//arrays are copied whole on little-endian hosts
+template <typename T, std::size_t N>
+void put_le_array(uint8_t*& out, const T (&values)[N]){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(out, values, sizeof(values));
+    out += sizeof(values);
+#else
+    for (T value : values) {
+        put_le(out, value);
+    }
+#endif
+}
+
+template <typename T, std::size_t N>
+void get_le_array(const uint8_t*& in, T (&values)[N]){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(values, in, sizeof(values));
+    in += sizeof(values);
+#else
+    for (T& value : values) {
+        value = get_le<T>(in);
+    }
+#endif
+}
+
+} // namespace
 
 Chip8::Chip8():pc(start_addr),stack{}, sp(0),delay_timer(0),
-sound_timer(0),draw_flag(false), I(0), V{}, keypad{false}, 
-memory{}, display{},player{}{
+sound_timer(0), I(0), V{}, keypad{false}, 
+memory{}, display{}{
     //load fontset into memory
     for (int i = 0; i < 80; ++i) {
         memory[i] = chip8_fontset[i];
     }
-    std::srand(static_cast<unsigned>(std::time(nullptr)));
+    invalidate_all();
+    seed(0);
+#ifdef CHIP8_PROFILE
+    profile_data = std::make_unique<Profile>();
+#endif
 }
 
+Chip8::~Chip8() = default;
+
 /**
  * Resets the Chip8 emulator back to its initial state.
  *
@@ -22,37 +81,115 @@ void Chip8::reset(){
     sp = 0;
     delay_timer = 0;
     sound_timer = 0;
-    draw_flag = false;
+    key_pressed = false;
     I = 0;
     for (int i = 0; i < 16; ++i) {
         V[i] = 0;
         keypad[i] = false;
     }
-    for (int i = 0; i < pixels_size; ++i) {
-        display[i] = 0;
-    }
+    memset(stack, 0, sizeof(stack));
+    memset(display, 0, sizeof(display));
+    seed(rng_seed);
 }    
 
+/**
+ * Seeds the generator behind Cxkk.
+ *
+ * Every machine has its own generator, so the random numbers a program
+ * sees depend only on the seed and on the instructions it runs. reset()
+ * restarts the generator from the same seed.
+ */
+void Chip8::seed(uint64_t seed){
+    rng_seed = seed;
+    rng_state = 0;
+    random_byte();
+    rng_state += seed;
+    random_byte();
+}
+
 
 /**
  * Updates the delay and sound timers.
  *
  * This function decrements the delay_timer and sound_timer if they are greater than zero.
- * If the sound_timer is greater than zero, the beep sound is started.
- * Once the sound_timer reaches zero, the beep sound is stopped.
+ * It returns true while the sound timer is running, when the host should
+ * play the beep sound.
  */
 
-void Chip8::update_timers(){
+bool Chip8::update_timers(){
     if (delay_timer > 0){
         delay_timer--;
     }
     if (sound_timer > 0){
         sound_timer--;
-        player.start_beep();
-        
-    }else{
-        player.stop_beep();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Returns true when the program is spinning in a loop that cannot make
+ * progress before the next timer tick or key event.
+ *
+ * This recognizes a jump to itself, the Fx07 / 3xkk / 1nnn delay timer wait
+ * before the timer reaches the awaited value, and Fx0A waiting for a key to
+ * be pressed or released. The host can sleep instead of emulating these.
+ */
+bool Chip8::is_idle() const{
+    auto word_at = [this](uint16_t addr){
+        return static_cast<uint16_t>((memory[addr & mem_mask] << 8) | memory[(addr + 1) & mem_mask]);
+    };
+    uint16_t addr = pc & mem_mask;
+    Instruction instruction = fuse(decode(word_at(addr)), word_at(addr + 2), word_at(addr + 4), addr);
+    switch (instruction.op)
+    {
+        case Op::JP:
+            return instruction.nnn == addr;
+        case Op::DELAY_WAIT:
+            return delay_timer != instruction.kk;
+        case Op::LD_VX_K:
+            if (key_pressed)
+                return keypad[V[instruction.x] & 0x0f];
+            for (bool key : keypad) {
+                if (key)
+                    return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+Chip8Registers Chip8::registers() const{
+    Chip8Registers registers;
+    memcpy(registers.V, V, sizeof(V));
+    registers.I = I;
+    registers.pc = pc;
+    registers.sp = sp;
+    registers.delay_timer = delay_timer;
+    registers.sound_timer = sound_timer;
+    memcpy(registers.stack, stack, sizeof(stack));
+    return registers;
+}
+
+/**
+ * Returns the 64-bit FNV-1a hash of the display, taking each row word as
+ * eight little-endian bytes so the value is the same on every host.
+ */
+uint64_t Chip8::framebuffer_hash() const{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint64_t row : display) {
+        for (int byte = 0; byte < 8; ++byte) {
+            hash ^= (row >> (8 * byte)) & 0xFF;
+            hash *= 0x100000001b3ull;
+        }
     }
+    return hash;
+}
+
+// Counts gathered by run, or nullptr unless built with CHIP8_PROFILE.
+const Profile* Chip8::profile() const{
+    return profile_data.get();
 }
 
 /**
@@ -80,19 +217,504 @@ bool Chip8::loadROM(const char* path){
         return false;
     }
 
-    rom_file.read(reinterpret_cast<char*>(memory + start_addr), rom_size);
+    std::vector<uint8_t> rom(rom_size);
+    rom_file.read(reinterpret_cast<char*>(rom.data()), rom_size);
     rom_file.close();
+    return loadROM(rom.data(), rom.size());
+}
+
+/**
+ * Loads a Chip8 ROM image already in memory at the program start address.
+ *
+ * The rest of memory is cleared and the fontset restored, so an instance
+ * can be reused for another ROM after reset() without leftovers from the
+ * previous one.
+ */
+bool Chip8::loadROM(const uint8_t* data, std::size_t size){
+    if (size > (mem_size - start_addr)){
+        std::cerr << "ROM file is too large." << std::endl;
+        return false;
+    }
+    memset(memory, 0, mem_size);
+    memcpy(memory, chip8_fontset, sizeof(chip8_fontset));
+    memcpy(memory + start_addr, data, size);
+    invalidate_all();
+    return true;
+}
+
+/**
+ * Writes the machine state to out, which must hold state_size bytes.
+ *
+ * The decode and translation caches are not part of the state; they are
+ * rebuilt from memory after loadState.
+ */
+void Chip8::saveState(uint8_t* out) const{
+    uint8_t* start = out;
+    memcpy(out, state_magic, sizeof(state_magic));
+    out += sizeof(state_magic);
+    put_le<uint16_t>(out, state_version);
+    put_le<uint16_t>(out, 0);
+    memcpy(out, memory, sizeof(memory));
+    out += sizeof(memory);
+    memcpy(out, V, sizeof(V));
+    out += sizeof(V);
+    put_le(out, I);
+    put_le(out, pc);
+    *out++ = sp;
+    *out++ = delay_timer;
+    *out++ = sound_timer;
+    *out++ = key_pressed;
+    put_le_array(out, stack);
+    put_le_array(out, display);
+    for (bool key : keypad) {
+        *out++ = key;
+    }
+    put_le(out, rng_seed);
+    put_le(out, rng_state);
+    put_le(out, crc32(start, out - start));
+}
+
+bool Chip8::saveState(const char* path) const{
+    uint8_t state[state_size];
+    saveState(state);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(state), sizeof(state))) {
+        std::cerr << "Failed to write state file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Restores a state written by saveState. Data of another size or version,
+ * or failing its CRC, is rejected and leaves the machine unchanged.
+ */
+bool Chip8::loadState(const uint8_t* data, std::size_t size){
+    if (size != state_size || memcmp(data, state_magic, sizeof(state_magic)) != 0) {
+        std::cerr << "Not a save state." << std::endl;
+        return false;
+    }
+    const uint8_t* in = data + sizeof(state_magic);
+    if (get_le<uint16_t>(in) != state_version) {
+        std::cerr << "Unsupported save state version." << std::endl;
+        return false;
+    }
+    const uint8_t* crc = data + state_size - 4;
+    if (get_le<uint32_t>(crc) != crc32(data, state_size - 4)) {
+        std::cerr << "Save state is corrupted." << std::endl;
+        return false;
+    }
+    in = data + state_header_size;
+    memcpy(memory, in, sizeof(memory));
+    in += sizeof(memory);
+    memcpy(V, in, sizeof(V));
+    in += sizeof(V);
+    I = get_le<uint16_t>(in);
+    pc = get_le<uint16_t>(in);
+    sp = *in++ & (stack_size - 1);
+    delay_timer = *in++;
+    sound_timer = *in++;
+    key_pressed = *in++;
+    get_le_array(in, stack);
+    get_le_array(in, display);
+    for (bool& key : keypad) {
+        key = *in++;
+    }
+    rng_seed = get_le<uint64_t>(in);
+    rng_state = get_le<uint64_t>(in);
+    invalidate_all();
+    return true;
+}
+
+bool Chip8::loadState(const char* path){
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open state file " << path << std::endl;
+        return false;
+    }
+    uint8_t state[state_size];
+    file.read(reinterpret_cast<char*>(state), sizeof(state));
+    if (file.gcount() != static_cast<std::streamsize>(state_size) || file.peek() != EOF) {
+        std::cerr << "Not a save state." << std::endl;
+        return false;
+    }
+    return loadState(state, state_size);
+}
+
+/**
+ * Registers a function called with the address and length of every write
+ * instructions make to memory. Loading a ROM or a state, or copying another
+ * machine, replaces all of memory and is reported as (0, mem_size).
+ */
+void Chip8::set_write_watch(std::function<void(uint16_t, uint16_t)> watch){
+    write_watch = std::move(watch);
+}
+
+/**
+ * Builds the handler for every instruction class.
+ *
+ * Each handler forwards the pre-split operands of a decoded instruction to
+ * the matching instruction method.
+ */
+constexpr std::array<Chip8::OpHandler, op_count> Chip8::make_op_handlers(){
+    std::array<OpHandler, op_count> handlers{};
+    auto set = [&handlers](Op op, OpHandler handler){
+        handlers[static_cast<uint8_t>(op)] = handler;
+    };
+    set(Op::CLS, [](Chip8& c, const Instruction&){ c.x00E0_clr(); });
+    set(Op::RET, [](Chip8& c, const Instruction&){ c.x00EE_return_from_subroutine(); });
+    set(Op::JP, [](Chip8& c, const Instruction& i){ c.x1nnn_jmp(i.nnn); });
+    set(Op::CALL, [](Chip8& c, const Instruction& i){ c.x2nnn_call_subroutine(i.nnn); });
+    set(Op::SE_BYTE, [](Chip8& c, const Instruction& i){ c.x3xkk_skip_if_equal(i.x, i.kk); });
+    set(Op::SNE_BYTE, [](Chip8& c, const Instruction& i){ c.x4xkk_skip_if_not_equal(i.x, i.kk); });
+    set(Op::SE_REG, [](Chip8& c, const Instruction& i){ c.x5xy0_skip_if_equal_reg(i.x, i.y); });
+    set(Op::LD_BYTE, [](Chip8& c, const Instruction& i){ c.x6xkk_set_reg(i.x, i.kk); });
+    set(Op::ADD_BYTE, [](Chip8& c, const Instruction& i){ c.x7xkk_add_byte(i.x, i.kk); });
+    set(Op::LD_REG, [](Chip8& c, const Instruction& i){ c.x8xy0_ld_reg(i.x, i.y); });
+    set(Op::OR, [](Chip8& c, const Instruction& i){ c.x8xy1_OR(i.x, i.y); });
+    set(Op::AND, [](Chip8& c, const Instruction& i){ c.x8xy2_AND(i.x, i.y); });
+    set(Op::XOR, [](Chip8& c, const Instruction& i){ c.x8xy3_XOR(i.x, i.y); });
+    set(Op::ADD_REG, [](Chip8& c, const Instruction& i){ c.x8xy4_add_reg_with_carry(i.x, i.y); });
+    set(Op::SUB, [](Chip8& c, const Instruction& i){ c.x8xy5_sub_reg(i.x, i.y); });
+    set(Op::SHR, [](Chip8& c, const Instruction& i){ c.x8xy6_shift_right(i.x, i.y); });
+    set(Op::SUBN, [](Chip8& c, const Instruction& i){ c.x8xy7_subn_reg(i.x, i.y); });
+    set(Op::SHL, [](Chip8& c, const Instruction& i){ c.x8xyE_shift_left(i.x, i.y); });
+    set(Op::SNE_REG, [](Chip8& c, const Instruction& i){ c.x9xy0_skip_if_not_equal_reg(i.x, i.y); });
+    set(Op::LD_I, [](Chip8& c, const Instruction& i){ c.xAnnn_setI(i.nnn); });
+    set(Op::JP_V0, [](Chip8& c, const Instruction& i){ c.xBnnn_JPV0(i.nnn); });
+    set(Op::RND, [](Chip8& c, const Instruction& i){ c.xCxkk_rnd(i.x, i.kk); });
+    set(Op::DRW, [](Chip8& c, const Instruction& i){ c.xDxyn_draw(i.x, i.y, i.n); });
+    set(Op::SKP, [](Chip8& c, const Instruction& i){ c.xEx9E_skip_if_key_pressed(i.x); });
+    set(Op::SKNP, [](Chip8& c, const Instruction& i){ c.xExA1_skip_if_key_not_pressed(i.x); });
+    set(Op::LD_VX_DT, [](Chip8& c, const Instruction& i){ c.xFx07_set_reg_delay_timer(i.x); });
+    set(Op::LD_VX_K, [](Chip8& c, const Instruction& i){ c.xFx0A_wait_for_key_press(i.x); });
+    set(Op::LD_DT_VX, [](Chip8& c, const Instruction& i){ c.xFx15_set_delay_timer_reg(i.x); });
+    set(Op::LD_ST_VX, [](Chip8& c, const Instruction& i){ c.xFx18_set_sound_timer_reg(i.x); });
+    set(Op::ADD_I, [](Chip8& c, const Instruction& i){ c.xFx1E_add_to_I(i.x); });
+    set(Op::LD_F, [](Chip8& c, const Instruction& i){ c.xFx29_set_I_to_font(i.x); });
+    set(Op::LD_B, [](Chip8& c, const Instruction& i){ c.xFx33_set_BCD(i.x); });
+    set(Op::LD_MEM_VX, [](Chip8& c, const Instruction& i){ c.xFx55_store_regs(i.x); });
+    set(Op::LD_VX_MEM, [](Chip8& c, const Instruction& i){ c.xFx65_load_regs(i.x); });
+    set(Op::NOP, [](Chip8&, const Instruction&){});
+    set(Op::UNKNOWN, [](Chip8& c, const Instruction&){
+        uint16_t addr = (c.pc - 2) & mem_mask;
+        std::cerr << "Unknown opcode: " << std::hex
+                  << ((c.memory[addr] << 8) | c.memory[(addr + 1) & mem_mask]) << std::endl;
+    });
+    //superinstructions execute only their first instruction here
+    set(Op::SE_BYTE_JP, [](Chip8& c, const Instruction& i){ c.skip_jump(c.V[i.x] == i.kk, i.nnn, 0); });
+    set(Op::SNE_BYTE_JP, [](Chip8& c, const Instruction& i){ c.skip_jump(c.V[i.x] != i.kk, i.nnn, 0); });
+    set(Op::SKP_JP, [](Chip8& c, const Instruction& i){ c.skip_jump(c.keypad[c.V[i.x] & 0x0f], i.nnn, 0); });
+    set(Op::SKNP_JP, [](Chip8& c, const Instruction& i){ c.skip_jump(!c.keypad[c.V[i.x] & 0x0f], i.nnn, 0); });
+    set(Op::LD_BYTE_LD_BYTE, [](Chip8& c, const Instruction& i){ c.x6xkk_6ykk_set_regs(i, 0); });
+    set(Op::ADD_BYTE_SE_BYTE, [](Chip8& c, const Instruction& i){ c.x7xkk_3ykk_add_skip(i, 0); });
+    set(Op::LD_I_DRW, [](Chip8& c, const Instruction& i){ c.xAnnn_Dxyn_set_I_draw(i, 0); });
+    set(Op::DELAY_WAIT, [](Chip8& c, const Instruction& i){ c.xFx07_3xkk_1nnn_delay_wait(i, 0); });
+    set(Op::UNDECODED, [](Chip8&, const Instruction&){});
+    return handlers;
+}
+
+constexpr std::array<Chip8::OpHandler, op_count> Chip8::op_handlers = Chip8::make_op_handlers();
+
+/**
+ * Fetches the instruction at pc already decoded and increments the program
+ * counter.
+ *
+ * Instructions at even addresses are decoded once into the decode cache and
+ * reused until a write to memory invalidates them. Odd addresses straddle
+ * two cache entries, so they are decoded from memory on every fetch.
+ * Cached entries may hold a superinstruction covering the following
+ * instructions as well.
+ */
+inline Instruction Chip8::fetchDecoded(){
+    if (pc & 1) {
+        return decode(fetchInstruction());
+    }
+    Instruction& cached = decode_cache[(pc & mem_mask) >> 1];
+    if (cached.op == Op::UNDECODED) {
+        uint16_t addr = pc & mem_mask;
+        Instruction first = decode(fetchInstruction());
+        uint16_t second = (memory[pc & mem_mask] << 8) | memory[(pc + 1) & mem_mask];
+        uint16_t third = (memory[(pc + 2) & mem_mask] << 8) | memory[(pc + 3) & mem_mask];
+        cached = fuse(first, second, third, addr);
+    } else {
+        pc += 2;
+    }
+    return cached;
+}
+
+/**
+ * Drops the decode cache entries overlapping the given memory range.
+ *
+ * A superinstruction spans up to three instructions, so the two entries
+ * before the range are dropped as well.
+ */
+inline void Chip8::invalidate(uint16_t addr, uint16_t len){
+    for (uint16_t i = 0; i < len + 4; ++i) {
+        decode_cache[((addr - 4 + i) & mem_mask) >> 1].op = Op::UNDECODED;
+    }
+    if (block_cache) {
+        invalidate_blocks(addr, len);
+    }
+    if (jit_cache) {
+        invalidate_jit(addr, len);
+    }
+    if (write_watch) {
+        write_watch(addr & mem_mask, len);
+    }
+}
+
+void Chip8::invalidate_all(){
+    for (auto& entry : decode_cache) {
+        entry.op = Op::UNDECODED;
+    }
+    if (block_cache) {
+        flush_blocks();
+    }
+    if (jit_cache) {
+        flush_jit();
+    }
+    if (write_watch) {
+        write_watch(0, mem_size);
+    }
+}
+
+/**
+ * Selects the execution engine used by run.
+ *
+ * The JIT is only available in x86-64 builds with CHIP8_JIT. Profiling
+ * builds count instructions in the interpreter only, so they run nothing
+ * else. An unavailable backend is rejected and the current one kept.
+ */
+bool Chip8::set_backend(Backend backend){
+#ifndef CHIP8_JIT_AVAILABLE
+    if (backend == Backend::Jit) {
+        std::cerr << "JIT not available in this build." << std::endl;
+        return false;
+    }
+#endif
+#ifdef CHIP8_PROFILE
+    if (backend != Backend::Interpreter) {
+        std::cerr << "Profiling builds only run the interpreter backend." << std::endl;
+        return false;
+    }
+#endif
+    this->backend = backend;
+    if (backend == Backend::Blocks && !block_cache) {
+        block_cache = std::make_unique<BlockCache>();
+    }
+    if (backend == Backend::Jit && !jit_cache) {
+        jit_cache = std::make_unique<JitCache>();
+    }
     return true;
 }
 
+// The engine run uses, which the JIT leaves if its code buffer fails.
+Backend Chip8::active_backend() const{
+    return backend;
+}
+
+/**
+ * Copies the processor state and memory of another machine.
+ */
+void Chip8::copy_state(const Chip8& other){
+    memcpy(V, other.V, sizeof(V));
+    memcpy(stack, other.stack, sizeof(stack));
+    memcpy(memory, other.memory, sizeof(memory));
+    memcpy(keypad, other.keypad, sizeof(keypad));
+    I = other.I;
+    pc = other.pc;
+    sp = other.sp;
+    delay_timer = other.delay_timer;
+    sound_timer = other.sound_timer;
+    key_pressed = other.key_pressed;
+    rng_seed = other.rng_seed;
+    rng_state = other.rng_state;
+    invalidate_all();
+}
+
+/**
+ * Emulates the given number of cycles of the Chip-8 processor with the
+ * selected backend. Profiling builds step through the reference decoder
+ * instead, so that every instruction is counted.
+ */
+void Chip8::run(uint32_t cycles){
+#ifdef CHIP8_PROFILE
+    profiled_run(cycles);
+#else
+    switch (backend)
+    {
+        case Backend::Blocks:
+            run_blocks(cycles);
+            break;
+        case Backend::Jit:
+            run_jit(cycles);
+            break;
+        default:
+            interpret(cycles);
+            break;
+    }
+#endif
+}
+
 /**
  * Emulates one cycle of the Chip-8 processor.
  *
+ * This function fetches the next decoded instruction and executes it
+ * through the handler table.
+ */
+void Chip8::emulateCycle(){
+    Instruction instruction = fetchDecoded();
+    op_handlers[static_cast<uint8_t>(instruction.op)](*this, instruction);
+}
+
+/**
+ * Interprets the given number of cycles of the Chip-8 processor.
+ *
+ * When built with CHIP8_THREADED_DISPATCH on GCC or Clang, this uses a
+ * direct-threaded interpreter: every handler ends with its own copy of the
+ * fetch and decode, so the indirect jump to the next handler is predicted
+ * per instruction class instead of through one shared dispatch branch.
+ * Other builds fall back to emulateCycle.
+ */
+void Chip8::interpret(uint32_t cycles){
+#if defined(CHIP8_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+    //labels in Op order
+    static void* const labels[] = {
+        &&op_CLS, &&op_RET, &&op_JP, &&op_CALL, &&op_SE_BYTE, &&op_SNE_BYTE,
+        &&op_SE_REG, &&op_LD_BYTE, &&op_ADD_BYTE, &&op_LD_REG, &&op_OR, &&op_AND,
+        &&op_XOR, &&op_ADD_REG, &&op_SUB, &&op_SHR, &&op_SUBN, &&op_SHL,
+        &&op_SNE_REG, &&op_LD_I, &&op_JP_V0, &&op_RND, &&op_DRW, &&op_SKP,
+        &&op_SKNP, &&op_LD_VX_DT, &&op_LD_VX_K, &&op_LD_DT_VX, &&op_LD_ST_VX,
+        &&op_ADD_I, &&op_LD_F, &&op_LD_B, &&op_LD_MEM_VX, &&op_LD_VX_MEM,
+        &&op_NOP, &&op_UNKNOWN, &&op_SE_BYTE_JP, &&op_SNE_BYTE_JP, &&op_SKP_JP,
+        &&op_SKNP_JP, &&op_LD_BYTE_LD_BYTE, &&op_ADD_BYTE_SE_BYTE, &&op_LD_I_DRW,
+        &&op_DELAY_WAIT, &&op_NOP
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == op_count, "labels must cover every Op");
+
+    Instruction i;
+#define DISPATCH()                                                         \
+    do {                                                                   \
+        if (cycles == 0) return;                                           \
+        --cycles;                                                          \
+        i = fetchDecoded();                                                \
+        goto *labels[static_cast<uint8_t>(i.op)];                          \
+    } while (0)
+
+    DISPATCH();
+op_CLS:       x00E0_clr(); DISPATCH();
+op_RET:       x00EE_return_from_subroutine(); DISPATCH();
+op_JP:        x1nnn_jmp(i.nnn); DISPATCH();
+op_CALL:      x2nnn_call_subroutine(i.nnn); DISPATCH();
+op_SE_BYTE:   x3xkk_skip_if_equal(i.x, i.kk); DISPATCH();
+op_SNE_BYTE:  x4xkk_skip_if_not_equal(i.x, i.kk); DISPATCH();
+op_SE_REG:    x5xy0_skip_if_equal_reg(i.x, i.y); DISPATCH();
+op_LD_BYTE:   x6xkk_set_reg(i.x, i.kk); DISPATCH();
+op_ADD_BYTE:  x7xkk_add_byte(i.x, i.kk); DISPATCH();
+op_LD_REG:    x8xy0_ld_reg(i.x, i.y); DISPATCH();
+op_OR:        x8xy1_OR(i.x, i.y); DISPATCH();
+op_AND:       x8xy2_AND(i.x, i.y); DISPATCH();
+op_XOR:       x8xy3_XOR(i.x, i.y); DISPATCH();
+op_ADD_REG:   x8xy4_add_reg_with_carry(i.x, i.y); DISPATCH();
+op_SUB:       x8xy5_sub_reg(i.x, i.y); DISPATCH();
+op_SHR:       x8xy6_shift_right(i.x, i.y); DISPATCH();
+op_SUBN:      x8xy7_subn_reg(i.x, i.y); DISPATCH();
+op_SHL:       x8xyE_shift_left(i.x, i.y); DISPATCH();
+op_SNE_REG:   x9xy0_skip_if_not_equal_reg(i.x, i.y); DISPATCH();
+op_LD_I:      xAnnn_setI(i.nnn); DISPATCH();
+op_JP_V0:     xBnnn_JPV0(i.nnn); DISPATCH();
+op_RND:       xCxkk_rnd(i.x, i.kk); DISPATCH();
+op_DRW:       xDxyn_draw(i.x, i.y, i.n); DISPATCH();
+op_SKP:       xEx9E_skip_if_key_pressed(i.x); DISPATCH();
+op_SKNP:      xExA1_skip_if_key_not_pressed(i.x); DISPATCH();
+op_LD_VX_DT:  xFx07_set_reg_delay_timer(i.x); DISPATCH();
+op_LD_VX_K:   xFx0A_wait_for_key_press(i.x); DISPATCH();
+op_LD_DT_VX:  xFx15_set_delay_timer_reg(i.x); DISPATCH();
+op_LD_ST_VX:  xFx18_set_sound_timer_reg(i.x); DISPATCH();
+op_ADD_I:     xFx1E_add_to_I(i.x); DISPATCH();
+op_LD_F:      xFx29_set_I_to_font(i.x); DISPATCH();
+op_LD_B:      xFx33_set_BCD(i.x); DISPATCH();
+op_LD_MEM_VX: xFx55_store_regs(i.x); DISPATCH();
+op_LD_VX_MEM: xFx65_load_regs(i.x); DISPATCH();
+op_NOP:       DISPATCH();
+op_UNKNOWN:
+    op_handlers[static_cast<uint8_t>(Op::UNKNOWN)](*this, i);
+    DISPATCH();
+op_SE_BYTE_JP:        cycles -= skip_jump(V[i.x] == i.kk, i.nnn, cycles); DISPATCH();
+op_SNE_BYTE_JP:       cycles -= skip_jump(V[i.x] != i.kk, i.nnn, cycles); DISPATCH();
+op_SKP_JP:            cycles -= skip_jump(keypad[V[i.x] & 0x0f], i.nnn, cycles); DISPATCH();
+op_SKNP_JP:           cycles -= skip_jump(!keypad[V[i.x] & 0x0f], i.nnn, cycles); DISPATCH();
+op_LD_BYTE_LD_BYTE:   cycles -= x6xkk_6ykk_set_regs(i, cycles); DISPATCH();
+op_ADD_BYTE_SE_BYTE:  cycles -= x7xkk_3ykk_add_skip(i, cycles); DISPATCH();
+op_LD_I_DRW:          cycles -= xAnnn_Dxyn_set_I_draw(i, cycles); DISPATCH();
+op_DELAY_WAIT:        cycles -= xFx07_3xkk_1nnn_delay_wait(i, cycles); DISPATCH();
+#undef DISPATCH
+#else
+    while (cycles) {
+        --cycles;
+        Instruction i = fetchDecoded();
+        if (is_fused(i.op)) {
+            cycles -= execute_fused(i, cycles);
+        } else {
+            op_handlers[static_cast<uint8_t>(i.op)](*this, i);
+        }
+    }
+#endif
+}
+
+/**
+ * Runs cycles instructions one at a time through the switch decoder,
+ * counting each by opcode family and address and timing Dxyn.
+ */
+void Chip8::profiled_run(uint32_t cycles){
+    auto start = std::chrono::steady_clock::now();
+    for (; cycles; --cycles) {
+        uint16_t addr = pc & mem_mask;
+        Op op = decode_op((memory[addr] << 8) | memory[(addr + 1) & mem_mask]);
+        ++profile_data->op_counts[static_cast<uint8_t>(op)];
+        ++profile_data->pc_counts[addr];
+        if (op == Op::DRW) {
+            auto draw_start = std::chrono::steady_clock::now();
+            emulateCycleSwitch();
+            profile_data->draw_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - draw_start).count();
+            ++profile_data->draws;
+        } else {
+            emulateCycleSwitch();
+        }
+        ++profile_data->instructions;
+    }
+    profile_data->run_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Executes a superinstruction as far as the remaining cycles allow and
+ * returns the number of instructions executed after the first.
+ */
+uint32_t Chip8::execute_fused(const Instruction& i, uint32_t cycles){
+    switch (i.op)
+    {
+        case Op::SE_BYTE_JP: return skip_jump(V[i.x] == i.kk, i.nnn, cycles);
+        case Op::SNE_BYTE_JP: return skip_jump(V[i.x] != i.kk, i.nnn, cycles);
+        case Op::SKP_JP: return skip_jump(keypad[V[i.x] & 0x0f], i.nnn, cycles);
+        case Op::SKNP_JP: return skip_jump(!keypad[V[i.x] & 0x0f], i.nnn, cycles);
+        case Op::LD_BYTE_LD_BYTE: return x6xkk_6ykk_set_regs(i, cycles);
+        case Op::ADD_BYTE_SE_BYTE: return x7xkk_3ykk_add_skip(i, cycles);
+        case Op::LD_I_DRW: return xAnnn_Dxyn_set_I_draw(i, cycles);
+        case Op::DELAY_WAIT: return xFx07_3xkk_1nnn_delay_wait(i, cycles);
+        default: return 0;
+    }
+}
+
+/**
+ * Emulates one cycle of the Chip-8 processor using the nested switch decoder.
+ *
  * This function fetches the next instruction from memory, decodes it, and
  * executes it. If the instruction is not recognized, an error message is
- * printed to the standard error stream.
+ * printed to the standard error stream. It is kept as the reference decoder
+ * for emulateCycle.
  */
-void Chip8::emulateCycle(){
+void Chip8::emulateCycleSwitch(){
     uint16_t instruction = fetchInstruction();
     //std::cout << std::hex << (int) instruction << std::endl;
 
@@ -277,15 +899,13 @@ void Chip8::emulateCycle(){
      */
 inline uint16_t Chip8::fetchInstruction(){
     uint16_t inst = 0 ;
-    inst = (memory[pc] << 8) | memory[pc+1];
+    inst = (memory[pc & mem_mask] << 8) | memory[(pc + 1) & mem_mask];
     pc += 2;
     return inst;
 }
 
 inline void Chip8::x00E0_clr(){
     memset(display, 0, sizeof(display));
-    draw_flag = true; 
-     
 }
 
 //1nnn - JP addr
@@ -304,14 +924,14 @@ inline void Chip8::x7xkk_add_byte(uint8_t reg , uint8_t value){
 }
 
 inline void Chip8::x00EE_return_from_subroutine(){
-    sp -= 1;
+    sp = (sp - 1) & (stack_size - 1);
     pc = stack[sp];
 }
 
 //2nnn - CALL addr
 inline void Chip8::x2nnn_call_subroutine(uint16_t addr){
     stack[sp] = pc;
-    sp += 1;
+    sp = (sp + 1) & (stack_size - 1);
     pc = addr;
 }
 
@@ -410,44 +1030,49 @@ inline void Chip8::xBnnn_JPV0(uint16_t addr){
     pc = addr + V[0];
 }
 
+//PCG32 (XSH RR): a 64-bit LCG step, with the old state permuted into the
+//output; Cxkk takes its top byte
+inline uint8_t Chip8::random_byte(){
+    uint64_t old = rng_state;
+    rng_state = old * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rot = static_cast<uint32_t>(old >> 59);
+    uint32_t output = (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    return output >> 24;
+}
+
 //Cxkk - RND Vx, byte
 inline void Chip8::xCxkk_rnd(uint8_t reg , uint8_t value){
-    V[reg] = (std::rand() % 256) & value;
+    V[reg] = random_byte() & value;
 }
 
+//Dxyn - DRW Vx, Vy, nibble
+//Each sprite row is shifted into place within a display row; the bits
+//shifted out past x = 63 are the horizontally clipped pixels.
 inline void Chip8::xDxyn_draw(uint8_t xi, uint8_t yi , uint8_t n){
     uint8_t x = V[xi] % 64;
     uint8_t y = V[yi] % 32;
-    V[0x0f] = 0;
+    uint64_t collision = 0;
     for(uint8_t row = 0 ; row < n ; ++row){
         uint8_t display_y = (y + row);
         if(display_y >= 32) break; // clip vertically
-        uint8_t spirit_byte = memory[I + row];
-        for(uint8_t col = 0 ; col < 8 ; ++col){
-            uint8_t display_x = (x + col);
-            if(display_x >= 64) break; // clip horizontally
-            uint8_t pixel = readbit(spirit_byte, (7 - col));
-            if(pixel){
-                if(display[display_x + (display_y * 64)] == 1){
-                    V[0x0f] = 1;
-                }
-                display[display_x + (display_y * 64)] ^= 1;    
-            } 
-        }
+        uint64_t sprite_row = (static_cast<uint64_t>(memory[(I + row) & mem_mask]) << 56) >> x;
+        collision |= display[display_y] & sprite_row;
+        display[display_y] ^= sprite_row;
     }
-    draw_flag = true;
+    V[0x0f] = collision ? 1 : 0;
 }
 
 //Ex9E - SKP Vx
 inline void Chip8::xEx9E_skip_if_key_pressed(uint8_t reg){
-    if(keypad[V[reg]]){
+    if(keypad[V[reg] & 0x0f]){
         pc += 2;
     }
 }
 
 //ExA1 - SKNP Vx
 inline void Chip8::xExA1_skip_if_key_not_pressed(uint8_t reg){
-    if(!keypad[V[reg]]){
+    if(!keypad[V[reg] & 0x0f]){
         pc += 2;
     }
 }
@@ -459,8 +1084,6 @@ inline void Chip8::xFx07_set_reg_delay_timer(uint8_t reg){
 
 // Fx0A - LD Vx, Key
 inline void Chip8::xFx0A_wait_for_key_press(uint8_t reg){
-    static bool key_pressed = false;
-    
     //scan only if no key pressed
     if(key_pressed == false)
         for(uint8_t i = 0 ; i < 16 ; ++i){
@@ -471,7 +1094,7 @@ inline void Chip8::xFx0A_wait_for_key_press(uint8_t reg){
             }
         }
     //wait for key release
-    else if(keypad[V[reg]] == 0){
+    else if(keypad[V[reg] & 0x0f] == 0){
         key_pressed = false;
         return;
     }
@@ -500,27 +1123,88 @@ inline void Chip8::xFx29_set_I_to_font(uint8_t reg){
 
 //Fx33 - LD B, Vx
 inline void Chip8::xFx33_set_BCD(uint8_t reg){
-    memory[I] = V[reg] / 100;
-    memory[I + 1] = (V[reg] / 10) % 10;
-    memory[I + 2] = V[reg] % 10;
+    memory[I & mem_mask] = V[reg] / 100;
+    memory[(I + 1) & mem_mask] = (V[reg] / 10) % 10;
+    memory[(I + 2) & mem_mask] = V[reg] % 10;
+    invalidate(I, 3);
 }
 
 //Fx55 - LD [I], Vx
 inline void Chip8::xFx55_store_regs(uint8_t reg){
     for(uint8_t i = 0 ; i <= reg ; ++i){
-        memory[I + i] = V[i];
+        memory[(I + i) & mem_mask] = V[i];
     }
+    invalidate(I, reg + 1);
     I += reg + 1;
 }
 
 //Fx65 - LD Vx, [I]
 inline void Chip8::xFx65_load_regs(uint8_t reg){
     for(uint8_t i = 0 ; i <= reg ; ++i){
-        V[i] = memory[I + i];
+        V[i] = memory[(I + i) & mem_mask];
     }
     I += reg + 1;
 }
 
+//3xkk, 4xkk, Ex9E, ExA1 + 1nnn
+inline uint32_t Chip8::skip_jump(bool skip, uint16_t addr, uint32_t cycles){
+    if (skip) {
+        pc += 2;
+        return 0;
+    }
+    if (cycles == 0)
+        return 0;
+    pc = addr;
+    return 1;
+}
+
+//6xkk + 6ykk
+inline uint32_t Chip8::x6xkk_6ykk_set_regs(const Instruction& i, uint32_t cycles){
+    V[i.x] = i.kk;
+    if (cycles == 0)
+        return 0;
+    V[i.y] = i.nnn;
+    pc += 2;
+    return 1;
+}
+
+//7xkk + 3ykk
+inline uint32_t Chip8::x7xkk_3ykk_add_skip(const Instruction& i, uint32_t cycles){
+    V[i.x] += i.kk;
+    if (cycles == 0)
+        return 0;
+    pc += V[i.y] == i.nnn ? 4 : 2;
+    return 1;
+}
+
+//Annn + Dxyn
+inline uint32_t Chip8::xAnnn_Dxyn_set_I_draw(const Instruction& i, uint32_t cycles){
+    I = i.nnn;
+    if (cycles == 0)
+        return 0;
+    pc += 2;
+    xDxyn_draw(i.x, i.y, i.n);
+    return 1;
+}
+
+//Fx07 + 3xkk + 1nnn
+//The timers only change between calls to run, so once the loop jumps back
+//it would spin until the cycles run out; those whole iterations are skipped
+//and leave the same state behind.
+inline uint32_t Chip8::xFx07_3xkk_1nnn_delay_wait(const Instruction& i, uint32_t cycles){
+    V[i.x] = delay_timer;
+    if (cycles == 0)
+        return 0;
+    pc += 2;
+    if (V[i.x] == i.kk) {
+        pc += 2;
+        return 1;
+    }
+    if (cycles == 1)
+        return 1;
+    pc = i.nnn;
+    return 2 + (cycles - 2) / 3 * 3;
+}
 
 //helpers
 inline uint8_t Chip8::readbit(uint8_t byte,uint8_t pos) {
@@ -1,15 +1,21 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <ctime>
+#include <memory>
+#include <vector>
 #include <string.h>
 
-#include "beepplayer.h"
+#include "opcodes.h"
 
 constexpr uint16_t pixels_size = 2048;
+constexpr uint8_t display_width = 64;    //pixels per display row, one bit each
+constexpr uint8_t display_rows = 32;
 constexpr uint16_t mem_size = 4096;
+constexpr uint16_t mem_mask = mem_size - 1; //addresses wrap at 4 KB
 constexpr uint16_t start_addr = 0x200;
 constexpr uint8_t stack_size = 16; 
 constexpr uint8_t chip8_fontset[80] =
@@ -33,19 +39,100 @@ constexpr uint8_t chip8_fontset[80] =
 };
 constexpr uint8_t font_start_addr = 0x50;
 
+//save state format: "C8ST", version, then memory, V, I, pc, sp, the
+//timers, the Fx0A key latch, stack, display, keypad and the Cxkk generator,
+//all little-endian, followed by a CRC-32 of everything before it
+constexpr uint16_t state_version = 1;
+constexpr std::size_t state_header_size = 8;
+constexpr std::size_t state_size = state_header_size + mem_size + 16 + 2 * 2 + 4
+                                 + stack_size * 2 + display_rows * 8 + 16 + 2 * 8 + 4;
+
 //#define readbit(byte, pos) byte | 0x01 << pos
 
+struct Block;
+struct BlockCache;
+struct JitCache;
+struct Profile;
+class Chip8Runtime;
+
+// A copy of the processor registers, for tools inspecting a machine.
+struct Chip8Registers {
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    uint16_t stack[stack_size];
+};
+
+// Execution engines selectable for Chip8::run.
+enum class Backend {
+    Interpreter,    //decode-cached interpreter (threaded when enabled)
+    Blocks,         //basic-block translation cache
+    Jit             //x86-64 native code for basic blocks
+};
+
 class Chip8 {
     
 public:
     Chip8();
+    ~Chip8();
     void emulateCycle();
+    void emulateCycleSwitch();
+    void run(uint32_t cycles);
+    bool set_backend(Backend backend);
+    Backend active_backend() const;
+    void set_jit_verify(bool enabled);
+    uint64_t jit_mismatches() const;
+    void set_jit_buffer_size(std::size_t bytes);
+    void set_write_watch(std::function<void(uint16_t, uint16_t)> watch);
     bool loadROM(const char* path);
+    bool loadROM(const uint8_t* data, std::size_t size);
+    void saveState(uint8_t* out) const;
+    bool saveState(const char* path) const;
+    bool loadState(const uint8_t* data, std::size_t size);
+    bool loadState(const char* path);
     void reset();
-    void update_timers();
+    void seed(uint64_t seed);
+    bool update_timers();
+    bool is_idle() const;
+    Chip8Registers registers() const;
+    uint64_t framebuffer_hash() const;
+    const Profile* profile() const;
 private:
+    friend class Chip8Runtime;
+    friend class LockstepEngine;
+
     uint16_t fetchInstruction();    
-    
+
+    Instruction fetchDecoded();
+    uint32_t execute_fused(const Instruction& instruction, uint32_t cycles);
+    void invalidate(uint16_t addr, uint16_t len);
+    void invalidate_all();
+    void interpret(uint32_t cycles);
+    void profiled_run(uint32_t cycles);
+
+    //block translation
+    void run_blocks(uint32_t cycles);
+    Block* translate_block(uint16_t start);
+    Block* lookup_block(uint16_t addr);
+    void invalidate_blocks(uint16_t addr, uint16_t len);
+    void flush_blocks();
+
+    //native code
+    void run_jit(uint32_t cycles);
+    void compile_jit_block(uint16_t start);
+    void invalidate_jit(uint16_t addr, uint16_t len);
+    void flush_jit();
+    void verify_jit_block(uint16_t start, uint8_t length);
+    void copy_state(const Chip8& other);
+
+    //dispatch
+    using OpHandler = void (*)(Chip8&, const Instruction&);
+    static constexpr std::array<OpHandler, op_count> make_op_handlers();
+    static const std::array<OpHandler, op_count> op_handlers;
+
     //helpers
     uint8_t readbit(uint8_t byte,uint8_t pos);
     uint8_t X(uint16_t instruction);
@@ -54,6 +141,7 @@ private:
     uint8_t kk(uint16_t instruction);
     uint8_t n(uint16_t instruction);
     uint8_t opcode(uint16_t instruction);
+    uint8_t random_byte();
 
     //instructions
     //00E0 - CLS
@@ -127,12 +215,30 @@ private:
     //Fx65 - LD Vx, [I]
     void xFx65_load_regs(uint8_t reg);
 
+    //superinstructions, cycles is the budget left after the first
+    //instruction, returns the number of further instructions executed
+    //3xkk, 4xkk, Ex9E, ExA1 + 1nnn
+    uint32_t skip_jump(bool skip, uint16_t addr, uint32_t cycles);
+    //6xkk + 6ykk
+    uint32_t x6xkk_6ykk_set_regs(const Instruction& i, uint32_t cycles);
+    //7xkk + 3ykk
+    uint32_t x7xkk_3ykk_add_skip(const Instruction& i, uint32_t cycles);
+    //Annn + Dxyn
+    uint32_t xAnnn_Dxyn_set_I_draw(const Instruction& i, uint32_t cycles);
+    //Fx07 + 3xkk + 1nnn
+    uint32_t xFx07_3xkk_1nnn_delay_wait(const Instruction& i, uint32_t cycles);
+
 public:
     bool keypad[16];
-    bool draw_flag;
-    uint8_t display[pixels_size];
+    uint64_t display[display_rows];     //one word per row, bit 63 is x = 0
 private:
     uint8_t memory[mem_size];
+    Instruction decode_cache[mem_size / 2]; //one entry per even address
+    Backend backend = Backend::Interpreter;
+    std::unique_ptr<BlockCache> block_cache;
+    std::unique_ptr<JitCache> jit_cache;
+    std::unique_ptr<Profile> profile_data;  //only allocated with CHIP8_PROFILE
+    std::function<void(uint16_t, uint16_t)> write_watch;
     uint16_t stack[stack_size];
     uint8_t V[16];
     uint16_t I;
@@ -140,5 +246,7 @@ private:
     uint8_t sp;
     uint8_t delay_timer;
     uint8_t sound_timer;
-    beepPlayer player;
+    bool key_pressed = false;   //Fx0A saw a key and waits for its release
+    uint64_t rng_seed = 0;      //Cxkk generator seed, restored by reset
+    uint64_t rng_state = 0;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "chip8env.h"
+
+#include "batchenv.h"
+
+struct chip8_env {
+    BatchEnv batch;
+
+    chip8_env(size_t count, unsigned threads): batch(count, threads) {}
+};
+
+static bool observation_format(int format, ObservationFormat& out){
+    if (format == CHIP8_OBSERVATION_BITS) out = ObservationFormat::Bits;
+    else if (format == CHIP8_OBSERVATION_BYTES) out = ObservationFormat::Bytes;
+    else return false;
+    return true;
+}
+
+chip8_env* chip8_env_create(size_t count, unsigned threads){
+    try {
+        return new chip8_env(count, threads);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void chip8_env_destroy(chip8_env* env){
+    delete env;
+}
+
+size_t chip8_env_size(const chip8_env* env){
+    return env->batch.size();
+}
+
+int chip8_env_load_rom(chip8_env* env, const uint8_t* data, size_t size){
+    try {
+        return env->batch.loadROM(data, size) ? 0 : -1;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int chip8_env_set_ipf(chip8_env* env, uint32_t ipf){
+    return env->batch.set_ipf(ipf) ? 0 : -1;
+}
+
+int chip8_env_reset(chip8_env* env, uint64_t seed){
+    try {
+        env->batch.reset(seed);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int chip8_env_step(chip8_env* env, const uint16_t* actions, uint32_t frames){
+    try {
+        env->batch.step(actions, frames);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int chip8_env_observe(chip8_env* env, uint8_t* out, int format){
+    ObservationFormat observation;
+    if (!observation_format(format, observation))
+        return -1;
+    try {
+        env->batch.observe(out, observation);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+size_t chip8_env_observation_size(int format){
+    ObservationFormat observation;
+    if (!observation_format(format, observation))
+        return 0;
+    return BatchEnv::observation_size(observation);
+}
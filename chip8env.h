@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * C interface to BatchEnv, for driving batches of Chip8 environments from
+ * other languages. All functions taking an environment handle require one
+ * returned by chip8_env_create. No C++ exception crosses this interface;
+ * failures are reported through the return values instead.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8_env chip8_env;
+
+/* observation layouts, see ObservationFormat */
+enum {
+    CHIP8_OBSERVATION_BITS = 0,
+    CHIP8_OBSERVATION_BYTES = 1
+};
+
+/* threads = 0 uses one thread per hardware thread; returns NULL on failure */
+chip8_env* chip8_env_create(size_t count, unsigned threads);
+void chip8_env_destroy(chip8_env* env);
+size_t chip8_env_size(const chip8_env* env);
+
+/* returns 0 on success, -1 if the ROM is too large or cannot be stored */
+int chip8_env_load_rom(chip8_env* env, const uint8_t* data, size_t size);
+/* returns 0 on success, -1 if ipf is 0 */
+int chip8_env_set_ipf(chip8_env* env, uint32_t ipf);
+
+/* reset, step and observe return 0 on success and -1 on failure */
+int chip8_env_reset(chip8_env* env, uint64_t seed);
+/* actions holds one keypad mask per environment, bit k for key k */
+int chip8_env_step(chip8_env* env, const uint16_t* actions, uint32_t frames);
+/* out must hold chip8_env_size(env) * chip8_env_observation_size(format)
+   bytes; fails for a format other than the CHIP8_OBSERVATION_ values */
+int chip8_env_observe(chip8_env* env, uint8_t* out, int format);
+/* returns 0 for an unknown format */
+size_t chip8_env_observation_size(int format);
+
+#ifdef __cplusplus
+}
+#endif
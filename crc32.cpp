@@ -0,0 +1,53 @@
+#include "crc32.h"
+
+#include <array>
+
+namespace {
+
+using Crc32Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+/**
+ * Builds the slicing-by-8 tables: tables[0] is the classic byte table, and
+ * tables[k] advances a byte's contribution past k further zero bytes, so
+ * eight input bytes can be folded in with eight independent lookups.
+ */
+constexpr Crc32Tables make_crc32_tables(){
+    Crc32Tables tables{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        tables[0][i] = value;
+    }
+    for (int k = 1; k < 8; ++k) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t previous = tables[k - 1][i];
+            tables[k][i] = (previous >> 8) ^ tables[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr Crc32Tables crc32_tables = make_crc32_tables();
+
+inline uint32_t load_le32(const uint8_t* data){
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+} // namespace
+
+uint32_t crc32(const uint8_t* data, std::size_t size, uint32_t crc){
+    const auto& t = crc32_tables;
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low = load_le32(data) ^ crc;
+        uint32_t high = load_le32(data + 4);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = t[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, as in zlib); pass a previous result to continue it.
+uint32_t crc32(const uint8_t* data, std::size_t size, uint32_t crc = 0);
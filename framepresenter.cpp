@@ -0,0 +1,92 @@
+#include "framepresenter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+constexpr auto refresh_interval = std::chrono::microseconds(1000000 / 60);
+
+FramePresenter::FramePresenter(Renderer& renderer): renderer(renderer) {}
+
+FramePresenter::~FramePresenter(){
+    renderer.destroy_renderer();
+}
+
+/**
+ * Creates the SDL renderer on the calling thread, which must own the
+ * window. Without vsync, refresh paces itself to 60 refreshes per second.
+ */
+bool FramePresenter::init(bool vsync){
+    this->vsync = vsync;
+    next_refresh = std::chrono::steady_clock::now();
+    return renderer.init_renderer(vsync);
+}
+
+/**
+ * Hands a copy of the display to the presenter. Never blocks; called from
+ * one thread only.
+ */
+void FramePresenter::publish(const uint64_t (&display)[CHIP8_HEIGHT]){
+    Frame& frame = frames.back();
+    memcpy(frame.rows, display, sizeof(frame.rows));
+    frame.sequence = sequence.load(std::memory_order_relaxed) + 1;
+    frame.published = std::chrono::steady_clock::now();
+    frames.publish();
+    sequence.store(frame.sequence, std::memory_order_relaxed);
+}
+
+FramePacingStats FramePresenter::stats() const{
+    FramePacingStats stats;
+    stats.published = sequence.load(std::memory_order_relaxed);
+    stats.presented = presented;
+    stats.dropped = dropped;
+    stats.duplicated = duplicated;
+    if (stats.presented) {
+        stats.average_latency_ms = latency_total_us / 1000.0 / stats.presented;
+    }
+    stats.max_latency_ms = latency_max_us / 1000.0;
+    return stats;
+}
+
+/**
+ * One display refresh, on the thread that called init: takes the newest
+ * frame if there is one, uploads the rows that differ from the last
+ * uploaded frame and presents.
+ *
+ * Comparing against the last upload rather than tracking draws keeps the
+ * texture right when frames are skipped.
+ */
+void FramePresenter::refresh(){
+    bool fresh = frames.update();
+    const Frame& frame = frames.front();
+    if (fresh) {
+        uint32_t dirty_rows = 0;
+        for (int y = 0; y < CHIP8_HEIGHT; ++y) {
+            if (frame.rows[y] != shown[y])
+                dirty_rows |= 1u << y;
+            shown[y] = frame.rows[y];
+        }
+        renderer.upload_rows(frame.rows, dirty_rows);
+        dropped += frame.sequence - last_sequence - 1;
+        last_sequence = frame.sequence;
+    } else if (last_sequence) {
+        ++duplicated;
+    }
+
+    renderer.present();
+
+    if (fresh) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - frame.published).count();
+        ++presented;
+        latency_total_us += latency;
+        latency_max_us = std::max<uint64_t>(latency_max_us, latency);
+    }
+    if (!vsync) {
+        next_refresh += refresh_interval;
+        auto now = std::chrono::steady_clock::now();
+        if (next_refresh < now)
+            next_refresh = now;     //fell behind, do not try to catch up
+        std::this_thread::sleep_until(next_refresh);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "renderer.h"
+#include "triplebuffer.h"
+
+// A display frame handed from the emulation thread to the presenter.
+struct Frame {
+    uint64_t rows[CHIP8_HEIGHT];
+    uint64_t sequence;                                  //1 for the first published frame
+    std::chrono::steady_clock::time_point published;
+};
+
+struct FramePacingStats {
+    uint64_t published = 0;
+    uint64_t presented = 0;         //published frames that reached the screen
+    uint64_t dropped = 0;           //published frames replaced before they were presented
+    uint64_t duplicated = 0;        //refreshes that presented the previous frame again
+    double average_latency_ms = 0;  //from publish to the end of the present
+    double max_latency_ms = 0;
+};
+
+/**
+ * Presents frames published by an emulation thread, so the emulation never
+ * blocks on SDL_RenderPresent or vsync.
+ *
+ * SDL only supports rendering on the thread that owns the window, so the
+ * presenter lives on the main thread together with the window and its
+ * event loop, and the emulation runs on a worker thread. Frames pass
+ * through a lock-free triple buffer: publish never waits, and each refresh
+ * presents the newest frame.
+ */
+class FramePresenter {
+public:
+    explicit FramePresenter(Renderer& renderer);
+    ~FramePresenter();
+    FramePresenter(const FramePresenter&) = delete;
+    FramePresenter& operator=(const FramePresenter&) = delete;
+
+    bool init(bool vsync);
+    void refresh();
+    void publish(const uint64_t (&display)[CHIP8_HEIGHT]);
+    FramePacingStats stats() const;
+private:
+    Renderer& renderer;
+    TripleBuffer<Frame> frames;
+    bool vsync = false;
+
+    std::atomic<uint64_t> sequence{0};     //last published frame, written by the publishing thread only
+
+    //presenting side
+    uint64_t shown[CHIP8_HEIGHT] = {};      //rows of the last uploaded frame
+    uint64_t last_sequence = 0;
+    std::chrono::steady_clock::time_point next_refresh;
+    uint64_t presented = 0;
+    uint64_t dropped = 0;
+    uint64_t duplicated = 0;
+    uint64_t latency_total_us = 0;
+    uint64_t latency_max_us = 0;
+};
@@ -0,0 +1,42 @@
+#include "framescheduler.h"
+
+#include <thread>
+
+constexpr auto spin_threshold = std::chrono::milliseconds(2);
+
+FrameScheduler::FrameScheduler(Clock::duration interval):
+interval(interval), deadline(Clock::now()) {}
+
+/**
+ * Makes the current time the start of the next frame.
+ */
+void FrameScheduler::restart(){
+    deadline = Clock::now();
+}
+
+/**
+ * Waits until the deadline of the next frame.
+ *
+ * When precise is false the wait only sleeps, trading timing accuracy for
+ * an idle CPU. If the loop has fallen more than a frame behind, the
+ * schedule restarts from now instead of running frames back to back to
+ * catch up.
+ */
+void FrameScheduler::wait_for_next_frame(bool precise){
+    deadline += interval;
+    auto now = Clock::now();
+    if (now >= deadline) {
+        if (now - deadline > interval)
+            deadline = now;
+        return;
+    }
+    if (!precise) {
+        std::this_thread::sleep_until(deadline);
+        return;
+    }
+    if (deadline - now > spin_threshold)
+        std::this_thread::sleep_until(deadline - spin_threshold);
+    while (Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
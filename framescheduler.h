@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+
+constexpr auto frame_interval_60hz = std::chrono::nanoseconds(1000000000 / 60);
+
+/**
+ * Paces a loop to a fixed frame rate on the monotonic clock.
+ *
+ * Deadlines advance by exactly one interval per frame, so sleep overshoot
+ * does not accumulate into drift. Waits sleep until shortly before the
+ * deadline and spin the rest of the way, since sleeps are only accurate to
+ * about a millisecond.
+ */
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FrameScheduler(Clock::duration interval = frame_interval_60hz);
+    void wait_for_next_frame(bool precise = true);
+    void restart();
+private:
+    Clock::duration interval;
+    Clock::time_point deadline;
+};
@@ -0,0 +1,141 @@
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include "chip8.h"
+#include "profiler.h"
+#include "replay.h"
+
+constexpr uint32_t default_ipf = 11;
+
+static bool parse_number(const char* text, uint64_t& value){
+    char* end = nullptr;
+    value = strtoull(text, &end, 10);
+    return *text && !*end;
+}
+
+static bool parse_backend(const char* name, Backend& backend){
+    if (strcmp(name, "interpreter") == 0) backend = Backend::Interpreter;
+    else if (strcmp(name, "blocks") == 0) backend = Backend::Blocks;
+    else if (strcmp(name, "jit") == 0) backend = Backend::Jit;
+    else return false;
+    return true;
+}
+
+static void usage(const char* name){
+    std::cerr << "Usage: " << name << " [--cycles N | --frames N] [--ipf N]"
+              << " [--seed N] [--replay file]"
+              << " [--backend interpreter|blocks|jit] [--display] <path_to_rom>" << std::endl;
+}
+
+/**
+ * Runs a ROM without display, input or audio and prints the final machine
+ * state and a hash of the framebuffer.
+ *
+ * --cycles runs a number of instructions without timer ticks; --frames runs
+ * frames of ipf instructions, each followed by one timer tick, as chip8 does.
+ * --replay runs a session recorded by chip8 --record with its seed, ipf
+ * and inputs, and checks the final machine state against the recording.
+ */
+int main(int argc, char* argv[]){
+    const char* rom_path = nullptr;
+    uint64_t cycles = 0;
+    uint64_t frames = 0;
+    uint64_t ipf = default_ipf;
+    uint64_t seed = 0;
+    Backend backend = Backend::Interpreter;
+    bool show_display = false;
+    const char* replay_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        bool ok = true;
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], cycles);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], frames);
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], ipf) && ipf > 0 && ipf <= UINT32_MAX;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            ok = parse_number(argv[++i], seed);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            ok = parse_backend(argv[++i], backend);
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--display") == 0) {
+            show_display = true;
+        } else if (!rom_path) {
+            rom_path = argv[i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!rom_path || (cycles && frames) || (replay_path && (cycles || frames))) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Chip8 chip8;
+    if (!chip8.loadROM(rom_path))
+        return 1;
+    if (!chip8.set_backend(backend))
+        return 1;
+    chip8.seed(seed);
+
+    Replay replay;
+    bool replay_matches = true;
+    if (replay_path) {
+        uint32_t rom_crc;
+        if (!load_replay(replay_path, replay) || !rom_crc32(rom_path, rom_crc))
+            return 1;
+        if (rom_crc != replay.rom_crc) {
+            std::cerr << "The replay was recorded with another ROM." << std::endl;
+            return 1;
+        }
+        chip8.seed(replay.seed);
+        run_scripted(chip8, replay.events, replay.cycles, replay.ipf);
+        replay_matches = chip8.framebuffer_hash() == replay.framebuffer_hash
+                      && state_crc32(chip8) == replay.state_crc;
+    }
+    while (cycles) {
+        uint32_t batch = cycles > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(cycles);
+        chip8.run(batch);
+        cycles -= batch;
+    }
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+        chip8.run(static_cast<uint32_t>(ipf));
+        chip8.update_timers();
+    }
+
+    Chip8Registers registers = chip8.registers();
+    std::cout << std::hex << std::setfill('0') << std::uppercase;
+    std::cout << "PC=" << std::setw(3) << registers.pc
+              << " I=" << std::setw(3) << registers.I
+              << " SP=" << static_cast<int>(registers.sp)
+              << " DT=" << std::setw(2) << static_cast<int>(registers.delay_timer)
+              << " ST=" << std::setw(2) << static_cast<int>(registers.sound_timer) << std::endl;
+    for (int i = 0; i < 16; ++i) {
+        std::cout << "V" << i << "=" << std::setw(2) << static_cast<int>(registers.V[i])
+                  << (i % 8 == 7 ? "\n" : " ");
+    }
+    std::cout << "FB=" << std::setw(16) << chip8.framebuffer_hash() << std::endl;
+
+    if (show_display) {
+        for (uint64_t row : chip8.display) {
+            for (int x = 0; x < 64; ++x) {
+                std::cout << (((row >> (63 - x)) & 1) ? '#' : '.');
+            }
+            std::cout << '\n';
+        }
+    }
+    if (const Profile* profile = chip8.profile())
+        write_profile_report(std::cout, *profile);
+    if (replay_path) {
+        std::cout << "Replay: " << std::dec << replay.cycles << " instructions, "
+                  << (replay_matches ? "state matches" : "state MISMATCH") << std::endl;
+    }
+    return replay_matches ? 0 : 1;
+}
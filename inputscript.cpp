@@ -0,0 +1,84 @@
+#include "inputscript.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/**
+ * Reads an input script: one event per line as "<cycle> <key> down|up",
+ * where key is a hex digit. Blank lines and lines starting with # are
+ * skipped. The events are returned ordered by cycle.
+ */
+bool load_input_script(const char* path, std::vector<InputEvent>& events){
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open input script " << path << std::endl;
+        return false;
+    }
+    events.clear();
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        std::istringstream fields(line);
+        std::string cycle, key, state;
+        if (!(fields >> cycle) || cycle[0] == '#')
+            continue;
+        fields >> key >> state;
+        char* end = nullptr;
+        InputEvent event;
+        event.cycle = strtoull(cycle.c_str(), &end, 10);
+        bool valid = !*end;
+        event.key = static_cast<uint8_t>(strtoul(key.c_str(), &end, 16));
+        valid = valid && key.size() == 1 && !*end && (state == "down" || state == "up");
+        if (!valid) {
+            std::cerr << path << ":" << number << ": expected \"<cycle> <key> down|up\"" << std::endl;
+            return false;
+        }
+        event.pressed = state == "down";
+        events.push_back(event);
+    }
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b){
+        return a.cycle < b.cycle;
+    });
+    return true;
+}
+
+ScriptedRun::ScriptedRun(Chip8& chip8, const std::vector<InputEvent>& events, uint32_t ipf):
+chip8(chip8), events(events), ipf(ipf){}
+
+/**
+ * Runs cycles more instructions, applying each event to the keypad right
+ * before its cycle and ticking the timers after every ipf instructions, as
+ * the frontend does once per frame. Events due when the run stops are
+ * applied too, so the keypad ends up as it was at that cycle.
+ */
+void ScriptedRun::run(uint64_t cycles){
+    uint64_t end = done + cycles;
+    while (true) {
+        while (next < events.size() && events[next].cycle <= done) {
+            chip8.keypad[events[next].key] = events[next].pressed;
+            ++next;
+        }
+        if (done == end)
+            break;
+        uint64_t stop = std::min(end, (done / ipf + 1) * ipf);
+        if (next < events.size())
+            stop = std::min(stop, events[next].cycle);
+        chip8.run(static_cast<uint32_t>(stop - done));
+        done = stop;
+        if (done % ipf == 0)
+            chip8.update_timers();
+    }
+}
+
+// Instructions run so far.
+uint64_t ScriptedRun::cycles() const{
+    return done;
+}
+
+// Runs cycles instructions from the start of a script.
+void run_scripted(Chip8& chip8, const std::vector<InputEvent>& events, uint64_t cycles, uint32_t ipf){
+    ScriptedRun(chip8, events, ipf).run(cycles);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+// A keypad transition, applied before the instruction numbered cycle runs.
+struct InputEvent {
+    uint64_t cycle;
+    uint8_t key;
+    bool pressed;
+};
+
+/**
+ * Runs a machine with its keypad driven by events, ticking the timers
+ * after every ipf instructions. Each call to run continues where the last
+ * one stopped, so a run can be split into slices.
+ */
+class ScriptedRun {
+public:
+    ScriptedRun(Chip8& chip8, const std::vector<InputEvent>& events, uint32_t ipf);
+    void run(uint64_t cycles);
+    uint64_t cycles() const;
+private:
+    Chip8& chip8;
+    const std::vector<InputEvent>& events;
+    uint32_t ipf;
+    uint64_t done = 0;
+    std::size_t next = 0;
+};
+
+bool load_input_script(const char* path, std::vector<InputEvent>& events);
+void run_scripted(Chip8& chip8, const std::vector<InputEvent>& events, uint64_t cycles, uint32_t ipf);
@@ -0,0 +1,520 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef CHIP8_JIT_AVAILABLE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef CHIP8_JIT_AVAILABLE
+
+CodeBuffer::CodeBuffer(size_t size){
+    page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    remap(size);
+}
+
+CodeBuffer::~CodeBuffer(){
+    release();
+}
+
+/**
+ * Replaces the buffer with an empty one of the given size. A size of 0, or
+ * a failed mapping, leaves the buffer unusable.
+ */
+void CodeBuffer::remap(size_t size){
+    release();
+    if (size == 0)
+        return;
+    void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        std::cerr << "Failed to map JIT code buffer." << std::endl;
+        return;
+    }
+    base = static_cast<uint8_t*>(mem);
+    this->size = size;
+}
+
+void CodeBuffer::release(){
+    if (base) {
+        munmap(base, size);
+    }
+    base = nullptr;
+    size = 0;
+    used = 0;
+}
+
+bool CodeBuffer::usable() const{
+    return base != nullptr;
+}
+
+/**
+ * Copies code into the buffer and returns its entry point, or nullptr if the
+ * buffer is full or unusable.
+ *
+ * Only the pages the code lands on are made writable while it is copied in,
+ * and executable again afterwards, so no page is ever both at once. If the
+ * protection of a page cannot be changed, the earlier code sharing it may
+ * no longer run either, so the buffer is released and every later install
+ * fails; callers flush their entry points when install fails.
+ */
+uint8_t* CodeBuffer::install(const std::vector<uint8_t>& code){
+    if (!base || used + code.size() > size)
+        return nullptr;
+    size_t first = used & ~(page_size - 1);
+    size_t last = (used + code.size() + page_size - 1) & ~(page_size - 1);
+    if (mprotect(base + first, last - first, PROT_READ | PROT_WRITE) != 0) {
+        std::cerr << "Failed to protect JIT code buffer." << std::endl;
+        release();
+        return nullptr;
+    }
+    uint8_t* entry = base + used;
+    memcpy(entry, code.data(), code.size());
+    if (mprotect(base + first, last - first, PROT_READ | PROT_EXEC) != 0) {
+        std::cerr << "Failed to protect JIT code buffer." << std::endl;
+        release();
+        return nullptr;
+    }
+    used += (code.size() + 15) & ~size_t(15);
+    return entry;
+}
+
+void CodeBuffer::clear(){
+    used = 0;
+}
+
+namespace {
+
+// x86-64 byte registers used by the generated code.
+enum Reg : uint8_t { AL = 0, CL = 1, DL = 2 };
+
+// Offsets of the Chip8 state from the object base held in rdi.
+struct StateLayout {
+    int32_t V;
+    int32_t I;
+    int32_t pc;
+    int32_t sp;
+    int32_t stack;
+    int32_t delay_timer;
+    int32_t sound_timer;
+    int32_t memory;
+};
+
+/**
+ * Emits x86-64 machine code addressing the Chip8 state as [rdi + disp32].
+ *
+ * Only rax, rcx and rdx are used as scratch registers, all caller-saved in
+ * the System V ABI, so generated blocks are plain leaf functions.
+ */
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    void byte(uint8_t b){ code.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs){ code.insert(code.end(), bs); }
+    void imm16(uint16_t v){ byte(v & 0xFF); byte(v >> 8); }
+    void imm32(uint32_t v){ for (int i = 0; i < 4; ++i) byte((v >> (8 * i)) & 0xFF); }
+
+    //opcode, then modrm for [rdi + disp32] with reg field r
+    void mem(std::initializer_list<uint8_t> opcode, uint8_t r, int32_t disp){
+        bytes(opcode);
+        byte(0x80 | (r << 3) | 7);
+        imm32(static_cast<uint32_t>(disp));
+    }
+
+    void load8(Reg r, int32_t disp){ mem({0x8A}, r, disp); }              //mov r8, [m]
+    void store8(int32_t disp, Reg r){ mem({0x88}, r, disp); }             //mov [m], r8
+    void store_imm8(int32_t disp, uint8_t v){ mem({0xC6}, 0, disp); byte(v); }
+    void add_imm8(int32_t disp, uint8_t v){ mem({0x80}, 0, disp); byte(v); }
+    void or8(int32_t disp){ mem({0x0A}, AL, disp); }                      //or al, [m]
+    void and8(int32_t disp){ mem({0x22}, AL, disp); }                     //and al, [m]
+    void xor8(int32_t disp){ mem({0x32}, AL, disp); }                     //xor al, [m]
+    void add8(int32_t disp){ mem({0x02}, AL, disp); }                     //add al, [m]
+    void sub8(int32_t disp){ mem({0x2A}, AL, disp); }                     //sub al, [m]
+    void cmp8(int32_t disp){ mem({0x3A}, AL, disp); }                     //cmp al, [m]
+    void movzx8(Reg r, int32_t disp){ mem({0x0F, 0xB6}, r, disp); }       //movzx r32, byte [m]
+    void movzx16(Reg r, int32_t disp){ mem({0x0F, 0xB7}, r, disp); }      //movzx r32, word [m]
+    void store16(int32_t disp, Reg r){ mem({0x66, 0x89}, r, disp); }      //mov [m], r16
+    void add16(int32_t disp, Reg r){ mem({0x66, 0x01}, r, disp); }        //add [m], r16
+    void store_imm16(int32_t disp, uint16_t v){ mem({0x66, 0xC7}, 0, disp); imm16(v); }
+    void add_imm16(int32_t disp, uint16_t v){ mem({0x66, 0x81}, 0, disp); imm16(v); }
+    void mov_eax_imm(uint32_t v){ byte(0xB8); imm32(v); }
+    void ret(){ byte(0xC3); }
+
+    //pc = taken if the flags satisfy the skip condition, otherwise next
+    void skip_pc(const StateLayout& s, uint8_t jcc_no_skip, uint16_t next){
+        store_imm16(s.pc, next);
+        bytes({jcc_no_skip, 9});   //jump over the 9 byte store below
+        store_imm16(s.pc, next + 2);
+    }
+};
+
+enum class Emit { Straight, Terminator, Unsupported };
+
+/**
+ * Emits the code for one instruction at the address before next.
+ *
+ * Each sequence mirrors the matching Chip8 handler, including the order in
+ * which Vx and VF are written.
+ */
+Emit emit_instruction(Emitter& e, const StateLayout& s, const Instruction& i, uint16_t next){
+    const int32_t vx = s.V + i.x;
+    const int32_t vy = s.V + i.y;
+    const int32_t vf = s.V + 0x0F;
+    switch (i.op)
+    {
+        case Op::LD_BYTE:
+            e.store_imm8(vx, i.kk);
+            return Emit::Straight;
+        case Op::ADD_BYTE:
+            e.add_imm8(vx, i.kk);
+            return Emit::Straight;
+        case Op::LD_REG:
+            e.load8(AL, vy);
+            e.store8(vx, AL);
+            return Emit::Straight;
+        case Op::OR:
+        case Op::AND:
+        case Op::XOR:
+            e.load8(AL, vx);
+            if (i.op == Op::OR) e.or8(vy);
+            else if (i.op == Op::AND) e.and8(vy);
+            else e.xor8(vy);
+            e.store8(vx, AL);
+            e.store_imm8(vf, 0);
+            return Emit::Straight;
+        case Op::ADD_REG:
+            e.load8(AL, vx);
+            e.add8(vy);
+            e.bytes({0x0F, 0x92, 0xC1});   //setc cl
+            e.store8(vx, AL);
+            e.store8(vf, CL);
+            return Emit::Straight;
+        case Op::SUB:
+            e.load8(AL, vx);
+            e.sub8(vy);
+            e.bytes({0x0F, 0x93, 0xC1});   //setnc cl
+            e.store8(vx, AL);
+            e.store8(vf, CL);
+            return Emit::Straight;
+        case Op::SUBN:
+            e.load8(AL, vy);
+            e.sub8(vx);
+            e.bytes({0x0F, 0x93, 0xC1});   //setnc cl
+            e.store8(vx, AL);
+            e.store8(vf, CL);
+            return Emit::Straight;
+        case Op::SHR:
+            e.load8(AL, vy);
+            e.bytes({0x88, 0xC1});         //mov cl, al
+            e.bytes({0x80, 0xE1, 0x01});   //and cl, 1
+            e.bytes({0xD0, 0xE8});         //shr al, 1
+            e.store8(vx, AL);
+            e.store8(vf, CL);
+            return Emit::Straight;
+        case Op::SHL:
+            e.load8(AL, vy);
+            e.bytes({0x88, 0xC1});         //mov cl, al
+            e.bytes({0xC0, 0xE9, 0x07});   //shr cl, 7
+            e.bytes({0xD0, 0xE0});         //shl al, 1
+            e.store8(vx, AL);
+            e.store8(vf, CL);
+            return Emit::Straight;
+        case Op::LD_I:
+            e.store_imm16(s.I, i.nnn);
+            return Emit::Straight;
+        case Op::ADD_I:
+            e.movzx8(AL, vx);
+            e.add16(s.I, AL);
+            return Emit::Straight;
+        case Op::LD_F:
+            e.movzx8(AL, vx);
+            e.bytes({0x8D, 0x04, 0x80});   //lea eax, [rax + rax * 4]
+            e.store16(s.I, AL);
+            return Emit::Straight;
+        case Op::LD_VX_DT:
+            e.load8(AL, s.delay_timer);
+            e.store8(vx, AL);
+            return Emit::Straight;
+        case Op::LD_DT_VX:
+            e.load8(AL, vx);
+            e.store8(s.delay_timer, AL);
+            return Emit::Straight;
+        case Op::LD_ST_VX:
+            e.load8(AL, vx);
+            e.store8(s.sound_timer, AL);
+            return Emit::Straight;
+        case Op::LD_VX_MEM:
+            e.movzx16(DL, s.I);
+            for (uint8_t r = 0; r <= i.x; ++r) {
+                e.bytes({0x8D, 0x82});     //lea eax, [rdx + r]
+                e.imm32(r);
+                e.byte(0x25);              //and eax, mem_mask
+                e.imm32(mem_mask);
+                e.bytes({0x8A, 0x8C, 0x07});   //mov cl, [rdi + rax + memory]
+                e.imm32(static_cast<uint32_t>(s.memory));
+                e.store8(s.V + r, CL);
+            }
+            e.add_imm16(s.I, i.x + 1);
+            return Emit::Straight;
+        case Op::NOP:
+            return Emit::Straight;
+
+        case Op::JP:
+            e.store_imm16(s.pc, i.nnn);
+            return Emit::Terminator;
+        case Op::JP_V0:
+            e.movzx8(AL, s.V);
+            e.byte(0x05);                  //add eax, nnn
+            e.imm32(i.nnn);
+            e.store16(s.pc, AL);
+            return Emit::Terminator;
+        case Op::CALL:
+            e.movzx8(AL, s.sp);
+            e.bytes({0x66, 0xC7, 0x84, 0x47});   //mov word [rdi + rax * 2 + stack], next
+            e.imm32(static_cast<uint32_t>(s.stack));
+            e.imm16(next);
+            e.bytes({0xFF, 0xC0});               //inc eax
+            e.bytes({0x83, 0xE0, stack_size - 1});
+            e.store8(s.sp, AL);
+            e.store_imm16(s.pc, i.nnn);
+            return Emit::Terminator;
+        case Op::RET:
+            e.movzx8(AL, s.sp);
+            e.bytes({0xFF, 0xC8});               //dec eax
+            e.bytes({0x83, 0xE0, stack_size - 1});
+            e.store8(s.sp, AL);
+            e.bytes({0x0F, 0xB7, 0x84, 0x47});   //movzx eax, word [rdi + rax * 2 + stack]
+            e.imm32(static_cast<uint32_t>(s.stack));
+            e.store16(s.pc, AL);
+            return Emit::Terminator;
+        case Op::SE_BYTE:
+        case Op::SNE_BYTE:
+            e.load8(AL, vx);
+            e.bytes({0x3C, i.kk});               //cmp al, kk
+            e.skip_pc(s, i.op == Op::SE_BYTE ? 0x75 : 0x74, next);
+            return Emit::Terminator;
+        case Op::SE_REG:
+        case Op::SNE_REG:
+            e.load8(AL, vx);
+            e.cmp8(vy);
+            e.skip_pc(s, i.op == Op::SE_REG ? 0x75 : 0x74, next);
+            return Emit::Terminator;
+
+        default:
+            //display, keypad, random numbers and memory writes stay in the interpreter
+            return Emit::Unsupported;
+    }
+}
+
+} // namespace
+
+/**
+ * Compiles the block starting at start into native code.
+ *
+ * Compilation stops before the first instruction the JIT leaves to the
+ * interpreter (Dxyn, Fx0A, Ex9E/ExA1, ...), after a control transfer, or
+ * after block_max_length instructions. If the very first instruction is
+ * not compilable, the entry is marked as interpreted.
+ */
+void Chip8::compile_jit_block(uint16_t start){
+    JitCache& jit = *jit_cache;
+    JitEntry& entry = jit.entries[start];
+    entry = JitEntry{};
+    entry.compiled = true;
+
+    auto offset = [this](const void* member){
+        return static_cast<int32_t>(static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(this));
+    };
+    const StateLayout layout{
+        offset(V), offset(&I), offset(&pc), offset(&sp), offset(stack),
+        offset(&delay_timer), offset(&sound_timer), offset(memory)
+    };
+
+    Emitter e;
+    uint32_t addr = start;
+    uint8_t length = 0;
+    bool terminated = false;
+    while (length < block_max_length && addr + 1 < mem_size) {
+        Instruction instruction = decode((memory[addr] << 8) | memory[addr + 1]);
+        Emit result = emit_instruction(e, layout, instruction, addr + 2);
+        if (result == Emit::Unsupported)
+            break;
+        ++length;
+        addr += 2;
+        if (result == Emit::Terminator) {
+            terminated = true;
+            break;
+        }
+    }
+    if (length == 0)
+        return;
+    if (!terminated) {
+        e.store_imm16(layout.pc, addr);
+    }
+    e.mov_eax_imm(length);
+    e.ret();
+
+    //a full buffer is flushed and the block compiled again; a block that
+    //does not fit even then is interpreted, and once the buffer has become
+    //unusable the machine switches to the interpreter for good
+    uint8_t* code = jit.buffer.install(e.code);
+    if (!code) {
+        flush_jit();
+        entry.compiled = true;
+        code = jit.buffer.install(e.code);
+        if (!code) {
+            if (!jit.buffer.usable()) {
+                std::cerr << "JIT code buffer unusable, switching to the interpreter." << std::endl;
+                backend = Backend::Interpreter;
+            }
+            return;
+        }
+    }
+    entry.code = reinterpret_cast<JitCode>(code);
+    entry.length = length;
+    entry.end = addr;
+    for (uint16_t page = start / block_page_size; page <= (addr - 1) / block_page_size; ++page) {
+        jit.page_blocks[page].push_back(start);
+    }
+}
+
+/**
+ * Drops the compiled blocks overlapping the given memory range. Their code
+ * stays in the buffer until the next flush.
+ */
+void Chip8::invalidate_jit(uint16_t addr, uint16_t len){
+    JitCache& jit = *jit_cache;
+    for (uint16_t i = 0; i < len; ++i) {
+        uint16_t written = (addr + i) & mem_mask;
+        std::vector<uint16_t>& starts = jit.page_blocks[written / block_page_size];
+        for (size_t k = 0; k < starts.size();) {
+            uint16_t start = starts[k];
+            JitEntry& entry = jit.entries[start];
+            if (written < start || written >= entry.end) {
+                ++k;
+                continue;
+            }
+            for (uint16_t page = start / block_page_size; page <= (entry.end - 1) / block_page_size; ++page) {
+                auto& list = jit.page_blocks[page];
+                list.erase(std::find(list.begin(), list.end(), start));
+            }
+            entry = JitEntry{};
+        }
+    }
+}
+
+void Chip8::flush_jit(){
+    for (auto& entry : jit_cache->entries) {
+        entry = JitEntry{};
+    }
+    for (auto& starts : jit_cache->page_blocks) {
+        starts.clear();
+    }
+    jit_cache->buffer.clear();
+}
+
+/**
+ * Emulates the given number of cycles, running compiled blocks where
+ * available and the interpreter for everything else.
+ *
+ * In verify mode every compiled block is also executed by a shadow machine
+ * using emulateCycleSwitch, and any difference in the resulting state is
+ * reported.
+ */
+void Chip8::run_jit(uint32_t cycles){
+    JitCache& jit = *jit_cache;
+    while (cycles) {
+        if (pc <= mem_mask) {
+            JitEntry& entry = jit.entries[pc];
+            if (!entry.compiled) {
+                compile_jit_block(pc);
+                if (backend != Backend::Jit) {
+                    interpret(cycles);
+                    return;
+                }
+            }
+            if (entry.code && entry.length <= cycles) {
+                if (jit.shadow) {
+                    jit.shadow->copy_state(*this);
+                }
+                uint16_t start = pc;
+                cycles -= entry.code(this);
+                if (jit.shadow) {
+                    verify_jit_block(start, entry.length);
+                }
+                continue;
+            }
+        }
+        emulateCycle();
+        --cycles;
+    }
+}
+
+/**
+ * Replays a compiled block on the shadow machine and compares the results.
+ */
+void Chip8::verify_jit_block(uint16_t start, uint8_t length){
+    Chip8& shadow = *jit_cache->shadow;
+    for (uint8_t i = 0; i < length; ++i) {
+        shadow.emulateCycleSwitch();
+    }
+    bool same = memcmp(V, shadow.V, sizeof(V)) == 0 && I == shadow.I && pc == shadow.pc
+        && sp == shadow.sp && memcmp(stack, shadow.stack, sizeof(stack)) == 0
+        && delay_timer == shadow.delay_timer && sound_timer == shadow.sound_timer;
+    if (!same) {
+        ++jit_cache->mismatches;
+        std::cerr << "JIT mismatch in block at " << std::hex << start
+                  << ": pc " << pc << " expected " << shadow.pc
+                  << ", I " << I << " expected " << shadow.I << std::dec << std::endl;
+    }
+}
+
+#else
+
+CodeBuffer::CodeBuffer(size_t){}
+CodeBuffer::~CodeBuffer(){}
+void CodeBuffer::remap(size_t){}
+void CodeBuffer::release(){}
+bool CodeBuffer::usable() const{ return false; }
+uint8_t* CodeBuffer::install(const std::vector<uint8_t>&){ return nullptr; }
+void CodeBuffer::clear(){}
+
+void Chip8::compile_jit_block(uint16_t){}
+void Chip8::invalidate_jit(uint16_t, uint16_t){}
+void Chip8::flush_jit(){}
+void Chip8::run_jit(uint32_t cycles){ interpret(cycles); }
+void Chip8::verify_jit_block(uint16_t, uint8_t){}
+
+#endif
+
+/**
+ * Enables or disables lockstep verification of compiled blocks against
+ * emulateCycleSwitch.
+ */
+void Chip8::set_jit_verify(bool enabled){
+    if (!jit_cache)
+        return;
+    if (enabled && !jit_cache->shadow) {
+        jit_cache->shadow = std::make_unique<Chip8>();
+    } else if (!enabled) {
+        jit_cache->shadow.reset();
+    }
+}
+
+uint64_t Chip8::jit_mismatches() const{
+    return jit_cache ? jit_cache->mismatches : 0;
+}
+
+/**
+ * Replaces the JIT code buffer with one of the given size, dropping every
+ * compiled block. Small buffers exercise flushing and the interpreter
+ * fallback; a size of 0 makes every install fail.
+ */
+void Chip8::set_jit_buffer_size(size_t bytes){
+    if (!jit_cache)
+        return;
+    flush_jit();
+    jit_cache->buffer.remap(bytes);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "blockcache.h"
+#include "chip8.h"
+
+#if defined(CHIP8_JIT) && defined(__x86_64__) && defined(__unix__)
+#define CHIP8_JIT_AVAILABLE 1
+#endif
+
+constexpr size_t jit_buffer_size = 1 << 20;
+
+// Compiled block entry point, returns the number of instructions executed.
+using JitCode = uint32_t (*)(Chip8*);
+
+struct JitEntry {
+    JitCode code = nullptr;   //null when the instruction at this address is interpreted
+    uint16_t end = 0;         //address past the last compiled instruction
+    uint8_t length = 0;       //instructions executed per call
+    bool compiled = false;
+};
+
+// Executable memory that is never writable and executable at the same time.
+class CodeBuffer {
+public:
+    explicit CodeBuffer(size_t size);
+    ~CodeBuffer();
+    CodeBuffer(const CodeBuffer&) = delete;
+    CodeBuffer& operator=(const CodeBuffer&) = delete;
+    void remap(size_t size);
+    bool usable() const;
+    uint8_t* install(const std::vector<uint8_t>& code);
+    void clear();
+private:
+    void release();
+
+    uint8_t* base = nullptr;
+    size_t size = 0;
+    size_t used = 0;
+    size_t page_size = 4096;
+};
+
+struct JitCache {
+    CodeBuffer buffer{jit_buffer_size};
+    JitEntry entries[mem_size];                        //indexed by start address
+    std::vector<uint16_t> page_blocks[block_pages];    //starts of the compiled blocks overlapping each page
+    std::unique_ptr<Chip8> shadow;                     //reference machine in verify mode
+    uint64_t mismatches = 0;
+};
@@ -1,5 +1,7 @@
 #include "keyshandler.h"
 
+#include <algorithm>
+
 KeysHandler::KeysHandler(bool (&keys)[KEYS_COUNT]): keys(keys) {}
 
 /*
@@ -23,9 +25,17 @@ Action KeysHandler::handle_keys() {
 
         if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE)  action = RESET;
 
+        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_TAB)  action = TOGGLE_TURBO;
+
+        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F5)  action = QUICKSAVE;
+
+        if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F9)  action = QUICKLOAD;
+
         if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
             bool isPressed = (event.type == SDL_KEYDOWN);
             switch (event.key.keysym.sym) {
+                case SDLK_BACKSPACE: rewind_held = isPressed; break;
+
                 case SDLK_1: keys[0x1] = isPressed; break;
                 case SDLK_2: keys[0x2] = isPressed; break;
                 case SDLK_3: keys[0x3] = isPressed; break;
@@ -54,3 +64,28 @@ Action KeysHandler::handle_keys() {
     return action;
 }
 
+// True while the rewind key is held down.
+bool KeysHandler::rewinding() const {
+    return rewind_held;
+}
+
+// Publishes the current key states, and the action if there is one.
+void InputMailbox::post(const bool (&keys)[KEYS_COUNT], bool rewinding, Action action){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::copy(keys, keys + KEYS_COUNT, this->keys);
+    this->rewinding = rewinding;
+    if (action != NO_ACTION)
+        actions.push_back(action);
+}
+
+// Copies out the latest key states and returns the oldest pending action.
+Action InputMailbox::take(bool (&keys)[KEYS_COUNT], bool& rewinding){
+    std::lock_guard<std::mutex> lock(mutex);
+    std::copy(this->keys, this->keys + KEYS_COUNT, keys);
+    rewinding = this->rewinding;
+    if (actions.empty())
+        return NO_ACTION;
+    Action action = actions.front();
+    actions.pop_front();
+    return action;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_keycode.h>
 
@@ -9,6 +11,9 @@ constexpr uint8_t KEYS_COUNT = 16;
 enum Action {
     EXIT,
     RESET,
+    TOGGLE_TURBO,
+    QUICKSAVE,
+    QUICKLOAD,
     NO_ACTION
 };
 
@@ -16,7 +21,25 @@ class KeysHandler {
 public:
     KeysHandler(bool (&keys)[KEYS_COUNT]);
     Action handle_keys();
+    bool rewinding() const;
     ~KeysHandler() = default;
 private:
     bool (&keys)[KEYS_COUNT];       
+    bool rewind_held = false;
+};
+
+/**
+ * Keyboard state handed from the event loop on the main thread to the
+ * emulation thread. The key states are sampled, the actions queued so that
+ * none is lost between two emulated frames.
+ */
+class InputMailbox {
+public:
+    void post(const bool (&keys)[KEYS_COUNT], bool rewinding, Action action);
+    Action take(bool (&keys)[KEYS_COUNT], bool& rewinding);
+private:
+    std::mutex mutex;
+    bool keys[KEYS_COUNT] = {};
+    bool rewinding = false;
+    std::deque<Action> actions;
 };
\ No newline at end of file
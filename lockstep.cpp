@@ -0,0 +1,568 @@
+#include "lockstep.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LOCKSTEP_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/**
+ * Kernels applying one instruction to the registers of n lanes.
+ *
+ * x, y and f are the lane arrays of Vx, Vy and VF and may be the same
+ * array, so every kernel reads its operands before writing, and writes
+ * VF last, exactly as the Chip8 handlers do.
+ */
+struct LaneKernels {
+    const char* name;
+    void (*add_byte)(uint8_t* x, uint8_t value, std::size_t n);
+    void (*bitwise)(Op op, uint8_t* x, const uint8_t* y, std::size_t n);
+    void (*arithmetic)(Op op, uint8_t* x, const uint8_t* y, uint8_t* f, std::size_t n);
+    void (*skip_byte)(uint16_t* pc, const uint8_t* x, uint8_t value, bool equal, std::size_t n);
+    void (*skip_reg)(uint16_t* pc, const uint8_t* x, const uint8_t* y, bool equal, std::size_t n);
+    void (*add_i)(uint16_t* i, const uint8_t* x, std::size_t n);
+    void (*decrement)(uint8_t* timer, std::size_t n);
+};
+
+void add_byte_scalar(uint8_t* x, uint8_t value, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        x[l] += value;
+    }
+}
+
+//8xy1, 8xy2, 8xy3
+void bitwise_scalar(Op op, uint8_t* x, const uint8_t* y, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        x[l] = op == Op::OR ? x[l] | y[l] : op == Op::AND ? x[l] & y[l] : x[l] ^ y[l];
+    }
+}
+
+//8xy4, 8xy5, 8xy6, 8xy7, 8xyE
+void arithmetic_scalar(Op op, uint8_t* x, const uint8_t* y, uint8_t* f, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        uint8_t a = x[l];
+        uint8_t b = y[l];
+        uint8_t result, carry;
+        switch (op)
+        {
+            case Op::ADD_REG: result = a + b; carry = a + b > 0xFF; break;
+            case Op::SUB: result = a - b; carry = a >= b; break;
+            case Op::SUBN: result = b - a; carry = b >= a; break;
+            case Op::SHR: result = b >> 1; carry = b & 0x1; break;
+            default: result = b << 1; carry = b >> 7; break;
+        }
+        x[l] = result;
+        f[l] = carry;
+    }
+}
+
+void skip_byte_scalar(uint16_t* pc, const uint8_t* x, uint8_t value, bool equal, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        if ((x[l] == value) == equal)
+            pc[l] += 2;
+    }
+}
+
+void skip_reg_scalar(uint16_t* pc, const uint8_t* x, const uint8_t* y, bool equal, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        if ((x[l] == y[l]) == equal)
+            pc[l] += 2;
+    }
+}
+
+void add_i_scalar(uint16_t* i, const uint8_t* x, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        i[l] += x[l];
+    }
+}
+
+void decrement_scalar(uint8_t* timer, std::size_t n){
+    for (std::size_t l = 0; l < n; ++l) {
+        if (timer[l] > 0)
+            timer[l]--;
+    }
+}
+
+#ifdef LOCKSTEP_X86
+
+/**
+ * AVX2 kernels, 32 lanes per byte register operation and 16 per 16-bit one;
+ * the lanes left over at the end go through the scalar kernels.
+ *
+ * Flags are computed as 0xFF masks with unsigned max comparisons, since
+ * AVX2 has no unsigned byte compare, and then narrowed to 0 or 1.
+ */
+__attribute__((target("avx2")))
+inline __m256i load32(const uint8_t* lanes){
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+}
+
+__attribute__((target("avx2")))
+inline void store32(uint8_t* lanes, __m256i value){
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), value);
+}
+
+__attribute__((target("avx2")))
+void add_byte_avx2(uint8_t* x, uint8_t value, std::size_t n){
+    const __m256i byte = _mm256_set1_epi8(static_cast<char>(value));
+    std::size_t l = 0;
+    for (; l + 32 <= n; l += 32) {
+        store32(x + l, _mm256_add_epi8(load32(x + l), byte));
+    }
+    add_byte_scalar(x + l, value, n - l);
+}
+
+__attribute__((target("avx2")))
+void bitwise_avx2(Op op, uint8_t* x, const uint8_t* y, std::size_t n){
+    std::size_t l = 0;
+    for (; l + 32 <= n; l += 32) {
+        __m256i a = load32(x + l);
+        __m256i b = load32(y + l);
+        store32(x + l, op == Op::OR ? _mm256_or_si256(a, b)
+                     : op == Op::AND ? _mm256_and_si256(a, b) : _mm256_xor_si256(a, b));
+    }
+    bitwise_scalar(op, x + l, y + l, n - l);
+}
+
+__attribute__((target("avx2")))
+void arithmetic_avx2(Op op, uint8_t* x, const uint8_t* y, uint8_t* f, std::size_t n){
+    const __m256i one = _mm256_set1_epi8(1);
+    std::size_t l = 0;
+    for (; l + 32 <= n; l += 32) {
+        __m256i a = load32(x + l);
+        __m256i b = load32(y + l);
+        __m256i result, carry;
+        switch (op)
+        {
+            case Op::ADD_REG:
+                //the sum wrapped if it is below a
+                result = _mm256_add_epi8(a, b);
+                carry = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(result, a), result), one);
+                break;
+            case Op::SUB:
+                result = _mm256_sub_epi8(a, b);
+                carry = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a), one);
+                break;
+            case Op::SUBN:
+                result = _mm256_sub_epi8(b, a);
+                carry = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(b, a), b), one);
+                break;
+            case Op::SHR:
+                result = _mm256_and_si256(_mm256_srli_epi16(b, 1), _mm256_set1_epi8(0x7F));
+                carry = _mm256_and_si256(b, one);
+                break;
+            default:
+                result = _mm256_add_epi8(b, b);
+                carry = _mm256_and_si256(_mm256_srli_epi16(b, 7), one);
+                break;
+        }
+        store32(x + l, result);
+        store32(f + l, carry);
+    }
+    arithmetic_scalar(op, x + l, y + l, f + l, n - l);
+}
+
+//widens a 0xFF lane mask to 16 bits and adds 2 to pc where it is set
+__attribute__((target("avx2")))
+inline void skip_masked(uint16_t* pc, __m128i mask){
+    __m256i step = _mm256_and_si256(_mm256_cvtepi8_epi16(mask), _mm256_set1_epi16(2));
+    __m256i* lanes = reinterpret_cast<__m256i*>(pc);
+    _mm256_storeu_si256(lanes, _mm256_add_epi16(_mm256_loadu_si256(lanes), step));
+}
+
+__attribute__((target("avx2")))
+void skip_byte_avx2(uint16_t* pc, const uint8_t* x, uint8_t value, bool equal, std::size_t n){
+    const __m128i byte = _mm_set1_epi8(static_cast<char>(value));
+    const __m128i invert = equal ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+    std::size_t l = 0;
+    for (; l + 16 <= n; l += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + l));
+        skip_masked(pc + l, _mm_xor_si128(_mm_cmpeq_epi8(a, byte), invert));
+    }
+    skip_byte_scalar(pc + l, x + l, value, equal, n - l);
+}
+
+__attribute__((target("avx2")))
+void skip_reg_avx2(uint16_t* pc, const uint8_t* x, const uint8_t* y, bool equal, std::size_t n){
+    const __m128i invert = equal ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+    std::size_t l = 0;
+    for (; l + 16 <= n; l += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + l));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + l));
+        skip_masked(pc + l, _mm_xor_si128(_mm_cmpeq_epi8(a, b), invert));
+    }
+    skip_reg_scalar(pc + l, x + l, y + l, equal, n - l);
+}
+
+__attribute__((target("avx2")))
+void add_i_avx2(uint16_t* i, const uint8_t* x, std::size_t n){
+    std::size_t l = 0;
+    for (; l + 16 <= n; l += 16) {
+        __m256i offset = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + l)));
+        __m256i* lanes = reinterpret_cast<__m256i*>(i + l);
+        _mm256_storeu_si256(lanes, _mm256_add_epi16(_mm256_loadu_si256(lanes), offset));
+    }
+    add_i_scalar(i + l, x + l, n - l);
+}
+
+__attribute__((target("avx2")))
+void decrement_avx2(uint8_t* timer, std::size_t n){
+    const __m256i one = _mm256_set1_epi8(1);
+    std::size_t l = 0;
+    for (; l + 32 <= n; l += 32) {
+        store32(timer + l, _mm256_subs_epu8(load32(timer + l), one));
+    }
+    decrement_scalar(timer + l, n - l);
+}
+
+#endif
+
+/**
+ * Returns a mask of the V registers an instruction can read or write, so
+ * the scalar path only moves those between the lane arrays and the
+ * machine.
+ */
+uint16_t touched_registers(const Instruction& instruction){
+    switch (instruction.op)
+    {
+        case Op::CLS: case Op::RET: case Op::JP: case Op::CALL: case Op::LD_I:
+        case Op::NOP: case Op::UNKNOWN:
+            return 0;
+        case Op::JP_V0:
+            return 1;
+        case Op::DRW:
+            return (1u << instruction.x) | (1u << instruction.y) | (1u << 0xF);
+        case Op::LD_MEM_VX:
+        case Op::LD_VX_MEM:
+            return (2u << instruction.x) - 1;
+        case Op::RND: case Op::SKP: case Op::SKNP: case Op::LD_VX_DT: case Op::LD_VX_K:
+        case Op::LD_DT_VX: case Op::LD_ST_VX: case Op::ADD_I: case Op::LD_F: case Op::LD_B:
+            return 1u << instruction.x;
+        default:
+            return 0xFFFF;
+    }
+}
+
+const LaneKernels& best_lane_kernels(){
+    static const LaneKernels best = []{
+#ifdef LOCKSTEP_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return LaneKernels{"avx2", add_byte_avx2, bitwise_avx2, arithmetic_avx2,
+                               skip_byte_avx2, skip_reg_avx2, add_i_avx2, decrement_avx2};
+#endif
+        return LaneKernels{"scalar", add_byte_scalar, bitwise_scalar, arithmetic_scalar,
+                           skip_byte_scalar, skip_reg_scalar, add_i_scalar, decrement_scalar};
+    }();
+    return best;
+}
+
+} // namespace
+
+LockstepEngine::LockstepEngine(std::size_t lanes):
+lanes(lanes), v(16 * lanes), i(lanes), pc(lanes, start_addr), sp(lanes),
+delay_timer(lanes), sound_timer(lanes){
+    for (std::size_t l = 0; l < lanes; ++l) {
+        machines.push_back(std::make_unique<Chip8>());
+    }
+}
+
+LockstepEngine::~LockstepEngine() = default;
+
+std::size_t LockstepEngine::size() const{
+    return lanes;
+}
+
+const char* LockstepEngine::kernel_name() const{
+    return best_lane_kernels().name;
+}
+
+/**
+ * Loads the same ROM image into every lane.
+ */
+bool LockstepEngine::loadROM(const uint8_t* data, std::size_t size){
+    for (auto& machine : machines) {
+        if (!machine->loadROM(data, size))
+            return false;
+    }
+    shared_memory = same_memory();
+    return true;
+}
+
+/**
+ * Resets every lane to its initial state, as Chip8::reset does, and clears
+ * the statistics.
+ */
+void LockstepEngine::reset(){
+    for (auto& machine : machines) {
+        machine->reset();
+    }
+    std::fill(v.begin(), v.end(), 0);
+    std::fill(i.begin(), i.end(), 0);
+    std::fill(pc.begin(), pc.end(), start_addr);
+    std::fill(sp.begin(), sp.end(), 0);
+    std::fill(delay_timer.begin(), delay_timer.end(), 0);
+    std::fill(sound_timer.begin(), sound_timer.end(), 0);
+    converged = true;
+    vector_steps = 0;
+    scalar_steps = 0;
+}
+
+// Seeds the Cxkk generator of one lane, see Chip8::seed.
+void LockstepEngine::seed(std::size_t lane, uint64_t seed){
+    machines[lane]->seed(seed);
+}
+
+/**
+ * Runs the given number of instructions on every lane.
+ */
+void LockstepEngine::run(uint32_t cycles){
+    if (lanes == 0)
+        return;
+    for (uint32_t cycle = 0; cycle < cycles; ++cycle) {
+        if (converged) {
+            uint16_t addr = pc[0];
+            const uint8_t* memory = machines[0]->memory;
+            uint16_t word = (memory[addr & mem_mask] << 8) | memory[(addr + 1) & mem_mask];
+            if ((shared_memory || same_instruction(addr)) && step_vector(decode(word))) {
+                ++vector_steps;
+                continue;
+            }
+        }
+        step_scalar();
+        ++scalar_steps;
+    }
+}
+
+// Ticks the delay and sound timers of every lane.
+void LockstepEngine::update_timers(){
+    best_lane_kernels().decrement(delay_timer.data(), lanes);
+    best_lane_kernels().decrement(sound_timer.data(), lanes);
+}
+
+bool* LockstepEngine::keypad(std::size_t lane){
+    return machines[lane]->keypad;
+}
+
+const uint64_t* LockstepEngine::display(std::size_t lane) const{
+    return machines[lane]->display;
+}
+
+Chip8Registers LockstepEngine::registers(std::size_t lane) const{
+    Chip8Registers registers = machines[lane]->registers();
+    for (int reg = 0; reg < 16; ++reg) {
+        registers.V[reg] = v[reg * lanes + lane];
+    }
+    registers.I = i[lane];
+    registers.pc = pc[lane];
+    registers.sp = sp[lane];
+    registers.delay_timer = delay_timer[lane];
+    registers.sound_timer = sound_timer[lane];
+    return registers;
+}
+
+uint64_t LockstepEngine::framebuffer_hash(std::size_t lane) const{
+    return machines[lane]->framebuffer_hash();
+}
+
+LockstepStats LockstepEngine::stats() const{
+    LockstepStats stats;
+    stats.vector_steps = vector_steps;
+    stats.scalar_steps = scalar_steps;
+    stats.steps = vector_steps + scalar_steps;
+    if (stats.steps)
+        stats.lane_utilization = static_cast<double>(vector_steps) / stats.steps;
+    return stats;
+}
+
+inline uint8_t* LockstepEngine::V(uint8_t reg){
+    return v.data() + reg * lanes;
+}
+
+/**
+ * Runs one instruction on all lanes at once, for the instructions that only
+ * touch the structure-of-arrays registers, the stack or the keypad. Returns
+ * false, having changed nothing, for the others.
+ */
+bool LockstepEngine::step_vector(const Instruction& instruction){
+    const LaneKernels& kernels = best_lane_kernels();
+    uint16_t next = pc[0] + 2;
+    uint8_t* x = V(instruction.x);
+    uint8_t* y = V(instruction.y);
+    switch (instruction.op)
+    {
+        case Op::JP:
+            std::fill(pc.begin(), pc.end(), instruction.nnn);
+            return true;
+        case Op::LD_BYTE:
+            memset(x, instruction.kk, lanes);
+            break;
+        case Op::ADD_BYTE:
+            kernels.add_byte(x, instruction.kk, lanes);
+            break;
+        case Op::LD_REG:
+            memmove(x, y, lanes);
+            break;
+        case Op::OR:
+        case Op::AND:
+        case Op::XOR:
+            kernels.bitwise(instruction.op, x, y, lanes);
+            memset(V(0xF), 0, lanes);
+            break;
+        case Op::ADD_REG:
+        case Op::SUB:
+        case Op::SHR:
+        case Op::SUBN:
+        case Op::SHL:
+            kernels.arithmetic(instruction.op, x, y, V(0xF), lanes);
+            break;
+        case Op::CALL:
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                machines[lane]->stack[sp[lane]] = next;
+                sp[lane] = (sp[lane] + 1) & (stack_size - 1);
+            }
+            std::fill(pc.begin(), pc.end(), instruction.nnn);
+            return true;
+        case Op::RET:
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                sp[lane] = (sp[lane] - 1) & (stack_size - 1);
+                pc[lane] = machines[lane]->stack[sp[lane]];
+            }
+            converged = same_pc();
+            return true;
+        case Op::JP_V0:
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                pc[lane] = instruction.nnn + V(0)[lane];
+            }
+            converged = same_pc();
+            return true;
+        case Op::SKP:
+        case Op::SKNP:
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                bool pressed = machines[lane]->keypad[x[lane] & 0x0f];
+                pc[lane] = pressed == (instruction.op == Op::SKP) ? next + 2 : next;
+            }
+            converged = same_pc();
+            return true;
+        case Op::LD_VX_K:
+            //waiting for a key with none pressed on any lane repeats the
+            //instruction; anything else takes the scalar path
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                const Chip8& machine = *machines[lane];
+                if (machine.key_pressed || std::find(machine.keypad, machine.keypad + 16, true) != machine.keypad + 16)
+                    return false;
+            }
+            return true;
+        case Op::LD_I:
+            std::fill(i.begin(), i.end(), instruction.nnn);
+            break;
+        case Op::LD_F:
+            for (std::size_t lane = 0; lane < lanes; ++lane) {
+                i[lane] = x[lane] * 5;
+            }
+            break;
+        case Op::ADD_I:
+            kernels.add_i(i.data(), x, lanes);
+            break;
+        case Op::LD_VX_DT:
+            memmove(x, delay_timer.data(), lanes);
+            break;
+        case Op::LD_DT_VX:
+            memmove(delay_timer.data(), x, lanes);
+            break;
+        case Op::LD_ST_VX:
+            memmove(sound_timer.data(), x, lanes);
+            break;
+        case Op::SE_BYTE:
+        case Op::SNE_BYTE:
+            std::fill(pc.begin(), pc.end(), next);
+            kernels.skip_byte(pc.data(), x, instruction.kk, instruction.op == Op::SE_BYTE, lanes);
+            converged = same_pc();
+            return true;
+        case Op::SE_REG:
+        case Op::SNE_REG:
+            std::fill(pc.begin(), pc.end(), next);
+            kernels.skip_reg(pc.data(), x, y, instruction.op == Op::SE_REG, lanes);
+            converged = same_pc();
+            return true;
+        default:
+            return false;
+    }
+    std::fill(pc.begin(), pc.end(), next);
+    return true;
+}
+
+/**
+ * Runs one instruction on every lane in turn, through the lane's own
+ * Chip8 machine.
+ */
+void LockstepEngine::step_scalar(){
+    bool wrote = false;
+    for (std::size_t lane = 0; lane < lanes; ++lane) {
+        Chip8& machine = *machines[lane];
+        uint16_t addr = pc[lane];
+        Instruction instruction = decode((machine.memory[addr & mem_mask] << 8) | machine.memory[(addr + 1) & mem_mask]);
+        wrote |= instruction.op == Op::LD_B || instruction.op == Op::LD_MEM_VX;
+        uint16_t touched = touched_registers(instruction);
+        load_lane(lane, touched);
+        machine.emulateCycle();
+        store_lane(lane, touched);
+    }
+    converged = same_pc();
+    if (wrote)
+        shared_memory = same_memory();
+}
+
+void LockstepEngine::load_lane(std::size_t lane, uint16_t touched){
+    Chip8& machine = *machines[lane];
+    for (int reg = 0; reg < 16; ++reg) {
+        if (touched & (1u << reg))
+            machine.V[reg] = v[reg * lanes + lane];
+    }
+    machine.I = i[lane];
+    machine.pc = pc[lane];
+    machine.sp = sp[lane];
+    machine.delay_timer = delay_timer[lane];
+    machine.sound_timer = sound_timer[lane];
+}
+
+void LockstepEngine::store_lane(std::size_t lane, uint16_t touched){
+    const Chip8& machine = *machines[lane];
+    for (int reg = 0; reg < 16; ++reg) {
+        if (touched & (1u << reg))
+            v[reg * lanes + lane] = machine.V[reg];
+    }
+    i[lane] = machine.I;
+    pc[lane] = machine.pc;
+    sp[lane] = machine.sp;
+    delay_timer[lane] = machine.delay_timer;
+    sound_timer[lane] = machine.sound_timer;
+}
+
+// Whether every lane has the same instruction word at addr as lane 0.
+bool LockstepEngine::same_instruction(uint16_t addr) const{
+    const uint8_t* first = machines[0]->memory;
+    for (std::size_t lane = 1; lane < lanes; ++lane) {
+        const uint8_t* memory = machines[lane]->memory;
+        if (memory[addr & mem_mask] != first[addr & mem_mask]
+            || memory[(addr + 1) & mem_mask] != first[(addr + 1) & mem_mask])
+            return false;
+    }
+    return true;
+}
+
+bool LockstepEngine::same_pc() const{
+    return std::all_of(pc.begin(), pc.end(), [this](uint16_t lane_pc){ return lane_pc == pc[0]; });
+}
+
+bool LockstepEngine::same_memory() const{
+    for (std::size_t lane = 1; lane < lanes; ++lane) {
+        if (memcmp(machines[lane]->memory, machines[0]->memory, mem_size) != 0)
+            return false;
+    }
+    return true;
+}
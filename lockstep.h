@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chip8.h"
+
+struct LockstepStats {
+    uint64_t steps = 0;             //instructions run by every lane
+    uint64_t vector_steps = 0;      //steps run for all lanes at once
+    uint64_t scalar_steps = 0;      //steps run lane by lane after the lanes diverged
+    double lane_utilization = 0;    //share of lane instructions run in vector steps
+};
+
+/**
+ * Steps many Chip8 machines running the same ROM in lockstep.
+ *
+ * V, I, pc, sp and the timers of all lanes are kept as structure-of-arrays,
+ * one contiguous array per register. While every lane is at the same pc
+ * with the same instruction there, register, stack and key-test
+ * instructions run for all lanes at once, the register ones with SIMD
+ * kernels (AVX2 when the CPU has it). Anything else, and every step once
+ * the lanes have diverged, runs lane by lane through Chip8::emulateCycle on
+ * the lane's own machine, which also holds its memory, stack, display and
+ * keypad. Branches that send lanes different ways make them diverge, and
+ * they converge again when their pcs meet.
+ */
+class LockstepEngine {
+public:
+    explicit LockstepEngine(std::size_t lanes);
+    ~LockstepEngine();
+    LockstepEngine(const LockstepEngine&) = delete;
+    LockstepEngine& operator=(const LockstepEngine&) = delete;
+
+    std::size_t size() const;
+    const char* kernel_name() const;
+    bool loadROM(const uint8_t* data, std::size_t size);
+    void reset();
+    void seed(std::size_t lane, uint64_t seed);
+    void run(uint32_t cycles);
+    void update_timers();
+
+    bool* keypad(std::size_t lane);
+    const uint64_t* display(std::size_t lane) const;
+    Chip8Registers registers(std::size_t lane) const;
+    uint64_t framebuffer_hash(std::size_t lane) const;
+    LockstepStats stats() const;
+private:
+    uint8_t* V(uint8_t reg);
+    bool step_vector(const Instruction& instruction);
+    void step_scalar();
+    void load_lane(std::size_t lane, uint16_t touched);
+    void store_lane(std::size_t lane, uint16_t touched);
+    bool same_instruction(uint16_t addr) const;
+    bool same_pc() const;
+    bool same_memory() const;
+
+    std::size_t lanes;
+    std::vector<std::unique_ptr<Chip8>> machines;
+
+    //structure-of-arrays registers, lanes entries each; v is register-major
+    std::vector<uint8_t> v;
+    std::vector<uint16_t> i;
+    std::vector<uint16_t> pc;
+    std::vector<uint8_t> sp;
+    std::vector<uint8_t> delay_timer;
+    std::vector<uint8_t> sound_timer;
+
+    bool converged = true;          //every lane is at the same pc
+    bool shared_memory = true;      //every lane has the same memory contents
+    uint64_t vector_steps = 0;
+    uint64_t scalar_steps = 0;
+};
@@ -1,58 +1,292 @@
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
 #include <thread>
-#include <chrono>
-#include <unistd.h>
 
+#include "beepplayer.h"
+#include "framescheduler.h"
+#include "framepresenter.h"
 #include "renderer.h"
 #include "keyshandler.h"
 #include "chip8.h"
+#include "profiler.h"
+#include "replay.h"
+#include "rewind.h"
 
-constexpr int64_t timer_interval_ms = 1000 / 60; // 16.67 ms
+constexpr uint32_t default_ipf = 11;   //instructions per 60 Hz frame
+constexpr uint32_t max_ipf = 1000000;
+constexpr unsigned long default_rewind_mb = 4;   //about 10 minutes at typical compression
+
+static bool parse_palette(const char* name, Palette& palette){
+    if (strcmp(name, "classic") == 0) palette = palette_classic;
+    else if (strcmp(name, "green") == 0) palette = palette_green;
+    else if (strcmp(name, "amber") == 0) palette = palette_amber;
+    else return false;
+    return true;
+}
+
+/**
+ * Plays a recorded session as fast as the host allows, publishing one frame
+ * per display refresh, and checks the final state against the recording.
+ * Returns false on a mismatch or when the window is closed first.
+ */
+static bool play_replay(Chip8& chip8, const Replay& replay, InputMailbox& input, FramePresenter& presenter){
+    ScriptedRun playback(chip8, replay.events, replay.ipf);
+    while (playback.cycles() < replay.cycles) {
+        //the keyboard only closes the window
+        bool ignored_keys[KEYS_COUNT];
+        bool rewinding;
+        if (input.take(ignored_keys, rewinding) == EXIT) {
+            std::cout << "Replay stopped after " << playback.cycles() << " instructions" << std::endl;
+            return false;
+        }
+        auto refresh_end = FrameScheduler::Clock::now() + frame_interval_60hz;
+        do {
+            playback.run(std::min<uint64_t>(replay.ipf, replay.cycles - playback.cycles()));
+        } while (playback.cycles() < replay.cycles && FrameScheduler::Clock::now() < refresh_end);
+        presenter.publish(chip8.display);
+    }
+    bool matches = chip8.framebuffer_hash() == replay.framebuffer_hash && state_crc32(chip8) == replay.state_crc;
+    std::cout << "Replay: " << replay.cycles << " instructions, "
+              << (matches ? "state matches" : "state MISMATCH") << std::endl;
+    return matches;
+}
 
 int main(int argc, char* argv[]){
-    
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <path_to_rom>" << std::endl;
+    const char* rom_path = nullptr;
+    Palette palette = palette_classic;
+    bool vsync = true;
+    bool turbo = false;
+    uint32_t ipf = default_ipf;
+    unsigned long rewind_mb = default_rewind_mb;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    uint64_t seed = (static_cast<uint64_t>(std::random_device{}()) << 32) | std::random_device{}();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-vsync") == 0) {
+            vsync = false;
+        } else if (strcmp(argv[i], "--turbo") == 0) {
+            turbo = true;
+        } else if (strcmp(argv[i], "--ipf") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            unsigned long value = strtoul(argv[++i], &end, 10);
+            if (*end || value == 0 || value > max_ipf) {
+                std::cerr << "--ipf takes a number of instructions from 1 to " << max_ipf << std::endl;
+                return 1;
+            }
+            ipf = static_cast<uint32_t>(value);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            seed = strtoull(argv[++i], &end, 10);
+            if (*end) {
+                std::cerr << "--seed takes a number" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--rewind-mb") == 0 && i + 1 < argc) {
+            char* end = nullptr;
+            rewind_mb = strtoul(argv[++i], &end, 10);
+            if (*end || rewind_mb > 4096) {
+                std::cerr << "--rewind-mb takes a number of megabytes from 0 to 4096" << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+            if (!parse_palette(argv[++i], palette)) {
+                std::cerr << "Unknown palette: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (!rom_path) {
+            rom_path = argv[i];
+        } else {
+            rom_path = nullptr;
+            break;
+        }
+    }
+    if (!rom_path || (record_path && replay_path)) {
+        std::cerr << "Usage: " << argv[0] << " [--ipf instructions_per_frame] [--turbo] [--seed N] [--rewind-mb N]"
+                  << " [--record file | --replay file] [--palette classic|green|amber] [--no-vsync] <path_to_rom>" << std::endl;
         return 1;
     }
    
+    //a replay brings its own seed and frame length
+    Replay replay;
+    uint32_t rom_crc = 0;
+    if ((record_path || replay_path) && !rom_crc32(rom_path, rom_crc))
+        return 1;
+    if (replay_path) {
+        if (!load_replay(replay_path, replay))
+            return 1;
+        if (rom_crc != replay.rom_crc) {
+            std::cerr << "The replay was recorded with another ROM." << std::endl;
+            return 1;
+        }
+        seed = replay.seed;
+        ipf = replay.ipf;
+    }
+
+    //SDL rendering stays on the main thread, which owns the window
     Renderer renderer;
-    if (!renderer.init_renderer())
+    if (!renderer.init_window())
+        return 1;
+    renderer.set_palette(palette);
+    FramePresenter presenter(renderer);
+    if (!presenter.init(vsync))
         return 1;
     Chip8 chip8;
-    if(!chip8.loadROM(argv[1]))
+    if(!chip8.loadROM(rom_path))
         return 1;
+    //printed so a session's random numbers can be reproduced with --seed
+    chip8.seed(seed);
+    std::cout << "Seed: " << seed << std::endl;
 
-    KeysHandler keyshandler(chip8.keypad);
-    auto last_time = std::chrono::high_resolution_clock::now();
-    
-    // Main game loop
-    while (true) {
-        //handle keys input
-        Action action = keyshandler.handle_keys();
-        if (action == EXIT) break;
-        if(action == RESET) {
-            chip8.reset();
-        }
-        //emulate cycle
-        chip8.emulateCycle();
-        
-        //update timers
-        auto current_time = std::chrono::high_resolution_clock::now();
-        auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_time);
-
-        if (elapsed_time.count() >= timer_interval_ms) {
-            chip8.update_timers();
-            last_time = current_time;    
-        }
-        //update screen    
-        if(chip8.draw_flag){
-                chip8.draw_flag = false;
-                renderer.render_frame(chip8.display);      
+    presenter.publish(chip8.display);
+
+    const std::string state_path = std::string(rom_path) + ".state";
+    FrameScheduler scheduler;
+    beepPlayer player;
+    RewindBuffer rewind(rewind_mb << 20);
+
+    //recording: keypad changes stamped with the instructions run before them
+    InputRecorder recorder;
+    uint64_t cycles = 0;
+    bool recording = record_path != nullptr;
+    auto stop_recording = [&]() {
+        if (!recording)
+            return;
+        recording = false;
+        recorder.record(chip8.keypad, cycles);
+        Replay session;
+        session.rom_crc = rom_crc;
+        session.seed = seed;
+        session.ipf = ipf;
+        session.cycles = cycles;
+        session.framebuffer_hash = chip8.framebuffer_hash();
+        session.state_crc = state_crc32(chip8);
+        session.events = recorder.events();
+        if (save_replay(record_path, session))
+            std::cout << "Recorded " << cycles << " instructions to " << record_path << std::endl;
+    };
+
+    //the emulation runs on a thread of its own and never waits for the
+    //display; the main thread handles window events and presents
+    InputMailbox input;
+    std::atomic<bool> finished{false};
+    bool replay_matches = true;
+    std::thread emulation([&]() {
+        if (replay_path)
+            replay_matches = play_replay(chip8, replay, input, presenter);
+        // Main game loop, one iteration per 60 Hz frame
+        while (!replay_path) {
+            //take the keys and any action posted by the event loop
+            bool rewinding = false;
+            Action action = input.take(chip8.keypad, rewinding);
+            if (action == EXIT) break;
+            //a replay cannot reproduce jumps in the machine state, so a
+            //recording ends before any
+            if (action == RESET || action == QUICKLOAD || rewinding)
+                stop_recording();
+            if (recording)
+                recorder.record(chip8.keypad, cycles);
+            if(action == RESET) {
+                chip8.reset();
+            }
+            if (action == TOGGLE_TURBO) {
+                turbo = !turbo;
+                scheduler.restart();
+            }
+            if (action == QUICKSAVE && chip8.saveState(state_path.c_str())) {
+                std::cout << "Saved state to " << state_path << std::endl;
+            }
+            if (action == QUICKLOAD) {
+                //the keys held right now stay held, whatever the state recorded
+                bool held[16];
+                memcpy(held, chip8.keypad, sizeof(held));
+                if (chip8.loadState(state_path.c_str())) {
+                    memcpy(chip8.keypad, held, sizeof(held));
+                    std::cout << "Loaded state from " << state_path << std::endl;
+                }
+            }
+
+            //rewind: step back one recorded frame per frame while the key is held
+            if (rewinding) {
+                player.stop_beep();
+                bool held[16];
+                memcpy(held, chip8.keypad, sizeof(held));
+                if (rewind.pop(chip8)) {
+                    memcpy(chip8.keypad, held, sizeof(held));
+                    presenter.publish(chip8.display);
+                }
+                scheduler.wait_for_next_frame(false);
+                continue;
+            }
+
+            //turbo: emulate frames back to back for one display refresh and
+            //present only the last, muted; the timers still tick once per ipf
+            //instructions, so the program sees the same timing
+            if (turbo) {
+                player.stop_beep();
+                auto refresh_end = FrameScheduler::Clock::now() + frame_interval_60hz;
+                do {
+                    chip8.run(ipf);
+                    cycles += ipf;
+                    chip8.update_timers();
+                } while (FrameScheduler::Clock::now() < refresh_end);
+                rewind.push(chip8);
+                presenter.publish(chip8.display);
+                continue;
+            }
+
+            //emulate a frame worth of instructions, then tick the timers once
+            chip8.run(ipf);
+            cycles += ipf;
+            if (chip8.update_timers()) {
+                player.start_beep();
+            } else {
+                player.stop_beep();
+            }
+
+            rewind.push(chip8);
+
+            //hand the frame to the presenter
+            presenter.publish(chip8.display);
+
+            //idle loops cannot progress before the next frame, so there is no
+            //need to spin for an exact deadline
+            scheduler.wait_for_next_frame(!chip8.is_idle());
         }
-        //8 instructions per 16ms
-        std::this_thread::sleep_for(std::chrono::milliseconds(16/8));
-    }        
+        stop_recording();
+        player.stop_beep();
+        finished.store(true, std::memory_order_release);
+    });
+
+    bool keys[KEYS_COUNT] = {};
+    KeysHandler keyshandler(keys);
+    while (!finished.load(std::memory_order_acquire)) {
+        Action action = keyshandler.handle_keys();
+        input.post(keys, keyshandler.rewinding(), action);
+        if (action == EXIT)
+            break;
+        presenter.refresh();
+    }
+    emulation.join();
 
-    return 0;
+    FramePacingStats stats = presenter.stats();
+    std::cout << "Frames: " << stats.published << " published, " << stats.presented << " presented, "
+              << stats.dropped << " dropped, " << stats.duplicated << " duplicated" << std::endl;
+    std::cout << "Latency: " << stats.average_latency_ms << " ms average, "
+              << stats.max_latency_ms << " ms max" << std::endl;
+    RewindStats rewind_stats = rewind.stats();
+    std::cout << "Rewind: " << rewind_stats.frames << " frames (" << rewind_stats.frames / 60 << " s) in "
+              << rewind_stats.bytes_used / 1024 << " of " << rewind_stats.capacity / 1024 << " KB, "
+              << rewind_stats.compression_ratio << ":1 compression" << std::endl;
+    if (const Profile* profile = chip8.profile())
+        write_profile_report(std::cout, *profile);
+    return replay_matches ? 0 : 1;
 }
\ No newline at end of file
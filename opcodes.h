@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+
+// Instruction classes of the Chip-8 instruction set, one per handler.
+enum class Op : uint8_t {
+    CLS,        //00E0 - CLS
+    RET,        //00EE - RET
+    JP,         //1nnn - JP addr
+    CALL,       //2nnn - CALL addr
+    SE_BYTE,    //3xkk - SE Vx, byte
+    SNE_BYTE,   //4xkk - SNE Vx, byte
+    SE_REG,     //5xy0 - SE Vx, Vy
+    LD_BYTE,    //6xkk - LD Vx, byte
+    ADD_BYTE,   //7xkk - ADD Vx, byte
+    LD_REG,     //8xy0 - LD Vx, Vy
+    OR,         //8xy1 - OR Vx, Vy
+    AND,        //8xy2 - AND Vx, Vy
+    XOR,        //8xy3 - XOR Vx, Vy
+    ADD_REG,    //8xy4 - ADD Vx, Vy
+    SUB,        //8xy5 - SUB Vx, Vy
+    SHR,        //8xy6 - SHR Vx {, Vy}
+    SUBN,       //8xy7 - SUBN Vx, Vy
+    SHL,        //8xyE - SHL Vx {, Vy}
+    SNE_REG,    //9xy0 - SNE Vx, Vy
+    LD_I,       //Annn - LD I, addr
+    JP_V0,      //Bnnn - JP V0, addr
+    RND,        //Cxkk - RND Vx, byte
+    DRW,        //Dxyn - DRW Vx, Vy, nibble
+    SKP,        //Ex9E - SKP Vx
+    SKNP,       //ExA1 - SKNP Vx
+    LD_VX_DT,   //Fx07 - LD Vx, DT
+    LD_VX_K,    //Fx0A - LD Vx, K
+    LD_DT_VX,   //Fx15 - LD DT, Vx
+    LD_ST_VX,   //Fx18 - LD ST, Vx
+    ADD_I,      //Fx1E - ADD I, Vx
+    LD_F,       //Fx29 - LD F, Vx
+    LD_B,       //Fx33 - LD B, Vx
+    LD_MEM_VX,  //Fx55 - LD [I], Vx
+    LD_VX_MEM,  //Fx65 - LD Vx, [I]
+    NOP,        //0nnn - SYS addr (ignored)
+    UNKNOWN,
+
+    //superinstructions, only produced by fuse
+    SE_BYTE_JP,         //3xkk + 1nnn
+    SNE_BYTE_JP,        //4xkk + 1nnn
+    SKP_JP,             //Ex9E + 1nnn
+    SKNP_JP,            //ExA1 + 1nnn
+    LD_BYTE_LD_BYTE,    //6xkk + 6ykk
+    ADD_BYTE_SE_BYTE,   //7xkk + 3ykk
+    LD_I_DRW,           //Annn + Dxyn
+    DELAY_WAIT,         //Fx07 + 3xkk + 1nnn back to the Fx07
+
+    UNDECODED   //marks an empty decode cache entry, never returned by decode_op
+};
+
+constexpr uint8_t op_count = static_cast<uint8_t>(Op::UNDECODED) + 1;
+
+constexpr bool is_fused(Op op){
+    return op > Op::UNKNOWN && op < Op::UNDECODED;
+}
+
+// An instruction with its operands already split out.
+struct Instruction {
+    Op op;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+    uint16_t nnn;
+};
+
+/**
+ * Maps an instruction word to its instruction class.
+ *
+ * This mirrors the nested switch of Chip8::emulateCycleSwitch and is usable
+ * in constant expressions, so dispatch tables can be built at compile time.
+ */
+constexpr Op decode_op(uint16_t instruction){
+    switch ((instruction & 0xF000) >> 12)
+    {
+        case 0x0:
+            if (instruction == 0x00E0) return Op::CLS;
+            if (instruction == 0x00EE) return Op::RET;
+            return Op::NOP;
+        case 0x1: return Op::JP;
+        case 0x2: return Op::CALL;
+        case 0x3: return Op::SE_BYTE;
+        case 0x4: return Op::SNE_BYTE;
+        case 0x5: return Op::SE_REG;
+        case 0x6: return Op::LD_BYTE;
+        case 0x7: return Op::ADD_BYTE;
+        case 0x8:
+            switch (instruction & 0x000F)
+            {
+                case 0x0: return Op::LD_REG;
+                case 0x1: return Op::OR;
+                case 0x2: return Op::AND;
+                case 0x3: return Op::XOR;
+                case 0x4: return Op::ADD_REG;
+                case 0x5: return Op::SUB;
+                case 0x6: return Op::SHR;
+                case 0x7: return Op::SUBN;
+                case 0xE: return Op::SHL;
+                default: return Op::UNKNOWN;
+            }
+        case 0x9: return Op::SNE_REG;
+        case 0xA: return Op::LD_I;
+        case 0xB: return Op::JP_V0;
+        case 0xC: return Op::RND;
+        case 0xD: return Op::DRW;
+        case 0xE:
+            switch (instruction & 0x00FF)
+            {
+                case 0x9E: return Op::SKP;
+                case 0xA1: return Op::SKNP;
+                default: return Op::UNKNOWN;
+            }
+        case 0xF:
+            switch (instruction & 0x00FF)
+            {
+                case 0x07: return Op::LD_VX_DT;
+                case 0x0A: return Op::LD_VX_K;
+                case 0x15: return Op::LD_DT_VX;
+                case 0x18: return Op::LD_ST_VX;
+                case 0x1E: return Op::ADD_I;
+                case 0x29: return Op::LD_F;
+                case 0x33: return Op::LD_B;
+                case 0x55: return Op::LD_MEM_VX;
+                case 0x65: return Op::LD_VX_MEM;
+                default: return Op::UNKNOWN;
+            }
+        default: return Op::UNKNOWN;
+    }
+}
+
+constexpr Instruction decode(uint16_t instruction){
+    return Instruction{
+        decode_op(instruction),
+        static_cast<uint8_t>((instruction & 0x0F00) >> 8),
+        static_cast<uint8_t>((instruction & 0x00F0) >> 4),
+        static_cast<uint8_t>(instruction & 0x000F),
+        static_cast<uint8_t>(instruction & 0x00FF),
+        static_cast<uint16_t>(instruction & 0x0FFF)
+    };
+}
+
+/**
+ * Combines an instruction with the ones following it into a superinstruction
+ * when they form one of the common sequences below, otherwise returns it
+ * unchanged.
+ *
+ * The first instruction keeps its operands; those of the second go into the
+ * fields it leaves unused:
+ *   skip + JP          nnn = jump target
+ *   LD_BYTE + LD_BYTE  y = second register, nnn = second byte
+ *   ADD_BYTE + SE_BYTE y = compared register, nnn = compared byte
+ *   LD_I + DRW         x, y, n = draw operands
+ *   DELAY_WAIT         kk = compared byte, nnn = loop address
+ * A delay wait is only fused when the skip tests the register just loaded
+ * and the jump goes back to addr, the address of the Fx07.
+ */
+constexpr Instruction fuse(Instruction first, uint16_t second_word, uint16_t third_word, uint16_t addr){
+    const Instruction second = decode(second_word);
+    Instruction fused = first;
+    switch (first.op)
+    {
+        case Op::SE_BYTE:
+        case Op::SNE_BYTE:
+        case Op::SKP:
+        case Op::SKNP:
+            if (second.op != Op::JP) break;
+            fused.op = first.op == Op::SE_BYTE ? Op::SE_BYTE_JP
+                     : first.op == Op::SNE_BYTE ? Op::SNE_BYTE_JP
+                     : first.op == Op::SKP ? Op::SKP_JP : Op::SKNP_JP;
+            fused.nnn = second.nnn;
+            break;
+        case Op::LD_BYTE:
+            if (second.op != Op::LD_BYTE) break;
+            fused.op = Op::LD_BYTE_LD_BYTE;
+            fused.y = second.x;
+            fused.nnn = second.kk;
+            break;
+        case Op::ADD_BYTE:
+            if (second.op != Op::SE_BYTE) break;
+            fused.op = Op::ADD_BYTE_SE_BYTE;
+            fused.y = second.x;
+            fused.nnn = second.kk;
+            break;
+        case Op::LD_I:
+            if (second.op != Op::DRW) break;
+            fused.op = Op::LD_I_DRW;
+            fused.x = second.x;
+            fused.y = second.y;
+            fused.n = second.n;
+            break;
+        case Op::LD_VX_DT: {
+            const Instruction third = decode(third_word);
+            if (second.op != Op::SE_BYTE || second.x != first.x
+                || third.op != Op::JP || third.nnn != addr) break;
+            fused.op = Op::DELAY_WAIT;
+            fused.kk = second.kk;
+            fused.nnn = addr;
+            break;
+        }
+        default:
+            break;
+    }
+    return fused;
+}
@@ -0,0 +1,139 @@
+#include "pixelexpander.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PIXELEXPANDER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline uint32_t* row_at(uint32_t* out, int pitch, int y){
+    return reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(out) + y * pitch);
+}
+
+void expand_rows_scalar(const uint64_t* rows, int count, uint32_t* out, int pitch, Palette palette){
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; ++x) {
+            line[x] = ((rows[y] >> (63 - x)) & 1) ? palette.foreground : palette.background;
+        }
+    }
+}
+
+void expand_bytes_scalar(const uint8_t* pixels, int count, uint32_t* out, int pitch, Palette palette){
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; ++x) {
+            line[x] = pixels[y * frame_width + x] ? palette.foreground : palette.background;
+        }
+    }
+}
+
+#ifdef PIXELEXPANDER_X86
+
+/**
+ * SSE2 kernels, four pixels per store.
+ *
+ * A lit pixel turns its lane into an all-ones mask, which selects between
+ * the two palette colors as background ^ ((background ^ foreground) & mask).
+ */
+__attribute__((target("sse2")))
+void expand_rows_sse2(const uint64_t* rows, int count, uint32_t* out, int pitch, Palette palette){
+    const __m128i background = _mm_set1_epi32(palette.background);
+    const __m128i difference = _mm_set1_epi32(palette.background ^ palette.foreground);
+    const __m128i bits = _mm_set_epi32(1, 2, 4, 8);
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; x += 4) {
+            __m128i nibble = _mm_set1_epi32(static_cast<int>((rows[y] >> (60 - x)) & 0xF));
+            __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(nibble, bits), bits);
+            __m128i argb = _mm_xor_si128(background, _mm_and_si128(difference, lit));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(line + x), argb);
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+void expand_bytes_sse2(const uint8_t* pixels, int count, uint32_t* out, int pitch, Palette palette){
+    const __m128i background = _mm_set1_epi32(palette.background);
+    const __m128i difference = _mm_set1_epi32(palette.background ^ palette.foreground);
+    const __m128i zero = _mm_setzero_si128();
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; x += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + y * frame_width + x));
+            //0xFF for every lit byte, then widened to 32-bit lanes
+            __m128i lit = _mm_xor_si128(_mm_cmpeq_epi8(bytes, zero), _mm_set1_epi8(-1));
+            __m128i lo = _mm_unpacklo_epi8(lit, lit);
+            __m128i hi = _mm_unpackhi_epi8(lit, lit);
+            __m128i masks[4] = {
+                _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+                _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi)
+            };
+            for (int i = 0; i < 4; ++i) {
+                __m128i argb = _mm_xor_si128(background, _mm_and_si128(difference, masks[i]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(line + x + 4 * i), argb);
+            }
+        }
+    }
+}
+
+// AVX2 kernels, eight pixels per store.
+__attribute__((target("avx2")))
+void expand_rows_avx2(const uint64_t* rows, int count, uint32_t* out, int pitch, Palette palette){
+    const __m256i background = _mm256_set1_epi32(palette.background);
+    const __m256i difference = _mm256_set1_epi32(palette.background ^ palette.foreground);
+    const __m256i bits = _mm256_set_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; x += 8) {
+            __m256i byte = _mm256_set1_epi32(static_cast<int>((rows[y] >> (56 - x)) & 0xFF));
+            __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(byte, bits), bits);
+            __m256i argb = _mm256_xor_si256(background, _mm256_and_si256(difference, lit));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(line + x), argb);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void expand_bytes_avx2(const uint8_t* pixels, int count, uint32_t* out, int pitch, Palette palette){
+    const __m256i background = _mm256_set1_epi32(palette.background);
+    const __m256i difference = _mm256_set1_epi32(palette.background ^ palette.foreground);
+    const __m256i zero = _mm256_setzero_si256();
+    for (int y = 0; y < count; ++y) {
+        uint32_t* line = row_at(out, pitch, y);
+        for (int x = 0; x < frame_width; x += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + y * frame_width + x));
+            __m256i unlit = _mm256_cmpeq_epi32(_mm256_cvtepu8_epi32(bytes), zero);
+            __m256i argb = _mm256_xor_si256(background, _mm256_andnot_si256(unlit, difference));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(line + x), argb);
+        }
+    }
+}
+
+#endif
+
+} // namespace
+
+/**
+ * Returns the kernels this CPU can run, ordered from slowest to fastest.
+ */
+std::vector<PixelExpander> supported_pixel_expanders(){
+    std::vector<PixelExpander> expanders{{"scalar", expand_rows_scalar, expand_bytes_scalar}};
+#ifdef PIXELEXPANDER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        expanders.push_back({"sse2", expand_rows_sse2, expand_bytes_sse2});
+    if (__builtin_cpu_supports("avx2"))
+        expanders.push_back({"avx2", expand_rows_avx2, expand_bytes_avx2});
+#endif
+    return expanders;
+}
+
+/**
+ * Returns the fastest kernels for this CPU, selected on first use.
+ */
+const PixelExpander& best_pixel_expander(){
+    static const PixelExpander best = supported_pixel_expanders().back();
+    return best;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+constexpr int frame_width = 64;
+constexpr int frame_height = 32;
+
+// Colors of lit and unlit pixels, in ARGB8888.
+struct Palette {
+    uint32_t background;
+    uint32_t foreground;
+};
+
+constexpr Palette palette_classic = {0x00000000, 0xFFFFFFFF};
+constexpr Palette palette_green = {0xFF0F380F, 0xFF9BBC0F};
+constexpr Palette palette_amber = {0xFF1A0F00, 0xFFFFB000};
+
+/**
+ * Kernels expanding frame rows into ARGB pixels for one instruction set.
+ *
+ * expand_rows takes one 64-bit word per row with bit 63 leftmost, as in
+ * Chip8::display; expand_bytes takes frame_width bytes per row, where any
+ * non-zero byte is lit. Both write count rows of frame_width pixels, pitch
+ * bytes apart, to out.
+ */
+struct PixelExpander {
+    const char* name;
+    void (*expand_rows)(const uint64_t* rows, int count, uint32_t* out, int pitch, Palette palette);
+    void (*expand_bytes)(const uint8_t* pixels, int count, uint32_t* out, int pitch, Palette palette);
+};
+
+std::vector<PixelExpander> supported_pixel_expanders();
+const PixelExpander& best_pixel_expander();
@@ -0,0 +1,99 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t hot_addresses = 20;
+constexpr int heatmap_width = 64;           //addresses per heatmap row
+constexpr char heatmap_levels[] = " .:-=+*#%@";
+
+//names of the base instructions in Op order
+constexpr const char* op_names[] = {
+    "00E0 CLS", "00EE RET", "1nnn JP", "2nnn CALL", "3xkk SE", "4xkk SNE",
+    "5xy0 SE", "6xkk LD", "7xkk ADD", "8xy0 LD", "8xy1 OR", "8xy2 AND",
+    "8xy3 XOR", "8xy4 ADD", "8xy5 SUB", "8xy6 SHR", "8xy7 SUBN", "8xyE SHL",
+    "9xy0 SNE", "Annn LD I", "Bnnn JP V0", "Cxkk RND", "Dxyn DRW", "Ex9E SKP",
+    "ExA1 SKNP", "Fx07 LD DT", "Fx0A LD K", "Fx15 LD DT", "Fx18 LD ST",
+    "Fx1E ADD I", "Fx29 LD F", "Fx33 LD B", "Fx55 LD [I]", "Fx65 LD [I]",
+    "0nnn SYS", "unknown"
+};
+static_assert(sizeof(op_names) / sizeof(op_names[0]) == static_cast<std::size_t>(Op::UNKNOWN) + 1,
+              "op_names must cover every base Op");
+
+double percent(uint64_t count, uint64_t total){
+    return total ? 100.0 * count / total : 0;
+}
+
+} // namespace
+
+/**
+ * Writes the opcode families and hottest addresses sorted by count, the
+ * Dxyn timing, and a heatmap of the 4 KB address space with one character
+ * per address on a log scale.
+ */
+void write_profile_report(std::ostream& out, const Profile& profile){
+    std::ios::fmtflags flags = out.flags();
+    char fill = out.fill();
+    out << std::dec << std::nouppercase << std::setfill(' ') << std::fixed << std::setprecision(2);
+    out << "Profile: " << profile.instructions << " instructions in " << profile.run_seconds * 1e3 << " ms" << std::endl;
+
+    std::vector<uint8_t> ops;
+    for (uint8_t op = 0; op <= static_cast<uint8_t>(Op::UNKNOWN); ++op) {
+        if (profile.op_counts[op])
+            ops.push_back(op);
+    }
+    std::stable_sort(ops.begin(), ops.end(), [&profile](uint8_t a, uint8_t b){
+        return profile.op_counts[a] > profile.op_counts[b];
+    });
+    out << "Opcode families:" << std::endl;
+    for (uint8_t op : ops) {
+        out << "  " << std::left << std::setw(12) << op_names[op] << std::right << std::setw(14)
+            << profile.op_counts[op] << std::setw(8) << percent(profile.op_counts[op], profile.instructions) << "%" << std::endl;
+    }
+
+    out << "Dxyn: " << profile.draws << " draws, " << profile.draw_seconds * 1e3 << " ms";
+    if (profile.draws)
+        out << ", " << profile.draw_seconds * 1e9 / profile.draws << " ns each";
+    if (profile.run_seconds > 0)
+        out << ", " << 100 * profile.draw_seconds / profile.run_seconds << "% of run time";
+    out << std::endl;
+
+    std::vector<uint16_t> addresses;
+    for (uint16_t addr = 0; addr < mem_size; ++addr) {
+        if (profile.pc_counts[addr])
+            addresses.push_back(addr);
+    }
+    std::stable_sort(addresses.begin(), addresses.end(), [&profile](uint16_t a, uint16_t b){
+        return profile.pc_counts[a] > profile.pc_counts[b];
+    });
+    out << "Hot addresses:" << std::endl;
+    for (std::size_t i = 0; i < std::min(addresses.size(), hot_addresses); ++i) {
+        uint16_t addr = addresses[i];
+        out << "  " << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << addr
+            << std::dec << std::setfill(' ') << std::setw(14) << profile.pc_counts[addr]
+            << std::setw(8) << percent(profile.pc_counts[addr], profile.instructions) << "%" << std::endl;
+    }
+
+    //the hottest address gets the last level, one execution the first non-blank one
+    const int top_level = sizeof(heatmap_levels) - 2;
+    uint64_t hottest = addresses.empty() ? 0 : profile.pc_counts[addresses[0]];
+    double scale = hottest > 1 ? std::log(static_cast<double>(hottest)) : 1;
+    out << "Heatmap, " << heatmap_width << " addresses per row, log scale \"" << heatmap_levels << "\":" << std::endl;
+    for (uint16_t row = 0; row < mem_size; row += heatmap_width) {
+        out << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << row << std::dec << std::setfill(' ') << " ";
+        for (uint16_t addr = row; addr < row + heatmap_width; ++addr) {
+            uint64_t count = profile.pc_counts[addr];
+            int level = 0;
+            if (count)
+                level = 1 + static_cast<int>((top_level - 1) * std::log(static_cast<double>(count)) / scale);
+            out << heatmap_levels[level];
+        }
+        out << std::endl;
+    }
+    out.flags(flags);
+    out.fill(fill);
+}
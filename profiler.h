@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+#include "chip8.h"
+
+/**
+ * Execution counts gathered by Chip8::run in builds with CHIP8_PROFILE.
+ *
+ * Every instruction is counted under its opcode family, as decoded from
+ * memory before any superinstruction fusion, and under the address it was
+ * fetched from. Dxyn is timed separately since drawing dominates many ROMs.
+ */
+struct Profile {
+    uint64_t op_counts[op_count] = {};
+    uint64_t pc_counts[mem_size] = {};
+    uint64_t instructions = 0;
+    uint64_t draws = 0;
+    double draw_seconds = 0;
+    double run_seconds = 0;         //wall time spent in Chip8::run
+};
+
+void write_profile_report(std::ostream& out, const Profile& profile);
@@ -0,0 +1,245 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "blockcache.h"
+#include "chip8.h"
+
+// A discovered block and the instruction words it contains.
+struct DiscoveredBlock {
+    uint16_t start;
+    std::vector<uint16_t> words;
+};
+
+static std::string format(const char* fmt, unsigned a = 0, unsigned b = 0, unsigned c = 0){
+    char buf[160];
+    snprintf(buf, sizeof(buf), fmt, a, b, c);
+    return buf;
+}
+
+/**
+ * Finds the code reachable from the start address by recursive descent.
+ *
+ * Blocks end at the same instructions as in the block translation backend.
+ * Direct jumps, calls, return addresses and skip targets are followed;
+ * Bnnn targets cannot be known statically and are left to the interpreter.
+ */
+static std::map<uint16_t, DiscoveredBlock> discover(const std::vector<uint8_t>& rom){
+    const uint32_t rom_end = start_addr + rom.size();
+    auto word_at = [&rom](uint32_t addr){
+        return static_cast<uint16_t>((rom[addr - start_addr] << 8) | rom[addr + 1 - start_addr]);
+    };
+
+    std::map<uint16_t, DiscoveredBlock> blocks;
+    std::vector<uint32_t> worklist{start_addr};
+    while (!worklist.empty()) {
+        uint32_t start = worklist.back();
+        worklist.pop_back();
+        if (start < start_addr || start + 1 >= rom_end || blocks.count(start))
+            continue;
+
+        DiscoveredBlock& block = blocks[start];
+        block.start = start;
+        uint32_t addr = start;
+        bool ends = false;
+        while (!ends && addr + 1 < rom_end && block.words.size() < block_max_length) {
+            uint16_t word = word_at(addr);
+            Instruction instruction = decode(word);
+            block.words.push_back(word);
+            uint32_t next = addr + 2;
+            addr = next;
+
+            ends = true;
+            switch (instruction.op)
+            {
+                case Op::JP:
+                    worklist.push_back(instruction.nnn);
+                    break;
+                case Op::CALL:
+                    worklist.push_back(instruction.nnn);
+                    worklist.push_back(next);
+                    break;
+                case Op::RET:
+                case Op::JP_V0:
+                    break;
+                case Op::SE_BYTE:
+                case Op::SNE_BYTE:
+                case Op::SE_REG:
+                case Op::SNE_REG:
+                case Op::SKP:
+                case Op::SKNP:
+                    worklist.push_back(next);
+                    worklist.push_back(next + 2);
+                    break;
+                case Op::LD_VX_K:
+                case Op::LD_B:
+                case Op::LD_MEM_VX:
+                    worklist.push_back(next);
+                    break;
+                default:
+                    ends = false;
+                    break;
+            }
+        }
+        if (!ends && block.words.size() == block_max_length) {
+            worklist.push_back(addr);
+        }
+    }
+    return blocks;
+}
+
+/**
+ * Emits the C++ statements for one instruction at addr.
+ *
+ * The statements follow the matching Chip8 handlers exactly. Display,
+ * keypad, random number and memory store instructions call back into the
+ * interpreter through Chip8Runtime::execute.
+ */
+static std::string emit_instruction(uint16_t word, uint16_t addr){
+    const Instruction i = decode(word);
+    const unsigned x = i.x, y = i.y, kk = i.kk, nnn = i.nnn, next = addr + 2;
+    switch (i.op)
+    {
+        case Op::LD_BYTE:   return format("rt.V[0x%X] = 0x%02X;", x, kk);
+        case Op::ADD_BYTE:  return format("rt.V[0x%X] += 0x%02X;", x, kk);
+        case Op::LD_REG:    return format("rt.V[0x%X] = rt.V[0x%X];", x, y);
+        case Op::OR:        return format("rt.V[0x%X] |= rt.V[0x%X]; rt.V[0xF] = 0;", x, y);
+        case Op::AND:       return format("rt.V[0x%X] &= rt.V[0x%X]; rt.V[0xF] = 0;", x, y);
+        case Op::XOR:       return format("rt.V[0x%X] ^= rt.V[0x%X]; rt.V[0xF] = 0;", x, y);
+        case Op::ADD_REG:
+            return format("{ uint16_t r = rt.V[0x%X] + rt.V[0x%X]; rt.V[0x%X] = r; rt.V[0xF] = r > 0xFF; }", x, y, x);
+        case Op::SUB:
+            return format("{ uint8_t c = rt.V[0x%X] >= rt.V[0x%X]; rt.V[0x%X] -= ", x, y, x)
+                 + format("rt.V[0x%X]; rt.V[0xF] = c; }", y);
+        case Op::SHR:
+            return format("{ rt.V[0x%X] = rt.V[0x%X]; uint8_t c = rt.V[0x%X] & 1; ", x, y, x)
+                 + format("rt.V[0x%X] >>= 1; rt.V[0xF] = c; }", x);
+        case Op::SUBN:
+            return format("{ uint8_t c = rt.V[0x%X] >= rt.V[0x%X]; rt.V[0x%X] = ", y, x, x)
+                 + format("rt.V[0x%X] - rt.V[0x%X]; rt.V[0xF] = c; }", y, x);
+        case Op::SHL:
+            return format("{ rt.V[0x%X] = rt.V[0x%X]; uint8_t c = rt.V[0x%X] >> 7; ", x, y, x)
+                 + format("rt.V[0x%X] <<= 1; rt.V[0xF] = c; }", x);
+        case Op::LD_I:      return format("rt.I = 0x%03X;", nnn);
+        case Op::ADD_I:     return format("rt.I += rt.V[0x%X];", x);
+        case Op::LD_F:      return format("rt.I = rt.V[0x%X] * 5;", x);
+        case Op::LD_VX_DT:  return format("rt.V[0x%X] = rt.delay_timer;", x);
+        case Op::LD_DT_VX:  return format("rt.delay_timer = rt.V[0x%X];", x);
+        case Op::LD_ST_VX:  return format("rt.sound_timer = rt.V[0x%X];", x);
+        case Op::LD_VX_MEM:
+            return format("for (int r = 0; r <= 0x%X; ++r) { rt.V[r] = rt.memory[(rt.I + r) & mem_mask]; } ", x)
+                 + format("rt.I += 0x%X;", x + 1);
+        case Op::NOP:       return "";
+
+        case Op::JP:        return format("rt.pc = 0x%03X;", nnn);
+        case Op::JP_V0:     return format("rt.pc = 0x%03X + rt.V[0];", nnn);
+        case Op::CALL:
+            return format("rt.stack[rt.sp] = 0x%03X; rt.sp = (rt.sp + 1) & (stack_size - 1); rt.pc = 0x%03X;", next, nnn);
+        case Op::RET:
+            return "rt.sp = (rt.sp - 1) & (stack_size - 1); rt.pc = rt.stack[rt.sp];";
+        case Op::SE_BYTE:
+            return format("rt.pc = rt.V[0x%X] == 0x%02X ? ", x, kk) + format("0x%03X : 0x%03X;", next + 2, next);
+        case Op::SNE_BYTE:
+            return format("rt.pc = rt.V[0x%X] != 0x%02X ? ", x, kk) + format("0x%03X : 0x%03X;", next + 2, next);
+        case Op::SE_REG:
+            return format("rt.pc = rt.V[0x%X] == rt.V[0x%X] ? ", x, y) + format("0x%03X : 0x%03X;", next + 2, next);
+        case Op::SNE_REG:
+            return format("rt.pc = rt.V[0x%X] != rt.V[0x%X] ? ", x, y) + format("0x%03X : 0x%03X;", next + 2, next);
+
+        default:
+            return format("rt.pc = 0x%03X; rt.execute(0x%04X);", next, word);
+    }
+}
+
+/**
+ * Returns true if the instruction leaves pc set itself.
+ */
+static bool sets_pc(uint16_t word){
+    switch (decode_op(word))
+    {
+        case Op::JP: case Op::JP_V0: case Op::CALL: case Op::RET:
+        case Op::SE_BYTE: case Op::SNE_BYTE: case Op::SE_REG: case Op::SNE_REG:
+        case Op::SKP: case Op::SKNP: case Op::LD_VX_K: case Op::LD_B: case Op::LD_MEM_VX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void emit_program(std::ostream& out, const std::string& rom_name,
+                         const std::vector<uint8_t>& rom,
+                         const std::map<uint16_t, DiscoveredBlock>& blocks){
+    out << "// Generated by chip8-recomp from " << rom_name << ". Do not edit.\n";
+    out << "#include \"recomp_runtime.h\"\n\n";
+    out << "namespace {\n\n";
+
+    out << "const uint8_t rom[] = {";
+    for (std::size_t i = 0; i < rom.size(); ++i) {
+        out << (i % 16 ? " " : "\n    ") << format("0x%02X,", rom[i]);
+    }
+    out << "\n};\n\n";
+
+    for (auto& [start, block] : blocks) {
+        out << format("void block_%03X(Chip8Runtime& rt){\n", start);
+        uint16_t addr = start;
+        for (uint16_t word : block.words) {
+            std::string code = emit_instruction(word, addr);
+            out << format("    //%03X: %04X\n", addr, word);
+            if (!code.empty())
+                out << "    " << code << "\n";
+            addr += 2;
+        }
+        if (!sets_pc(block.words.back())) {
+            out << format("    rt.pc = 0x%03X;\n", addr);
+        }
+        out << "}\n\n";
+    }
+
+    out << "const RecompiledBlock blocks[] = {\n";
+    for (auto& [start, block] : blocks) {
+        unsigned end = start + 2 * block.words.size();
+        out << format("    {0x%03X, 0x%03X, %u, ", start, end, block.words.size())
+            << format("block_%03X},\n", start);
+    }
+    out << "};\n\n";
+    out << "} // namespace\n\n";
+    out << "extern const RecompiledProgram chip8_recompiled_program = {\n"
+        << "    rom, sizeof(rom), blocks, sizeof(blocks) / sizeof(blocks[0])\n};\n";
+}
+
+int main(int argc, char* argv[]){
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <path_to_rom> <output.cpp>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream rom_file(argv[1], std::ios::binary);
+    if (!rom_file.is_open()) {
+        std::cerr << "Failed to open ROM file." << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(rom_file)), std::istreambuf_iterator<char>());
+    if (rom.empty() || rom.size() > mem_size - start_addr) {
+        std::cerr << "ROM file is empty or too large." << std::endl;
+        return 1;
+    }
+
+    std::map<uint16_t, DiscoveredBlock> blocks = discover(rom);
+
+    std::ofstream out(argv[2]);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open output file." << std::endl;
+        return 1;
+    }
+    emit_program(out, argv[1], rom, blocks);
+
+    std::size_t instructions = 0;
+    for (auto& entry : blocks) {
+        instructions += entry.second.words.size();
+    }
+    std::cout << blocks.size() << " blocks, " << instructions << " instructions" << std::endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include "recomp_runtime.h"
+#include "blockcache.h"
+
+#include <algorithm>
+#include <cstring>
+
+Chip8Runtime::Chip8Runtime(Chip8& chip8, const RecompiledProgram& program):
+V(chip8.V), I(chip8.I), pc(chip8.pc), sp(chip8.sp), stack(chip8.stack),
+delay_timer(chip8.delay_timer), sound_timer(chip8.sound_timer), memory(chip8.memory),
+chip8(chip8), program(program){
+    chip8.set_write_watch([this](uint16_t addr, uint16_t len){ on_write(addr, len); });
+}
+
+Chip8Runtime::~Chip8Runtime(){
+    chip8.set_write_watch(nullptr);
+}
+
+/**
+ * Loads the ROM image of the program and enables all its blocks.
+ */
+bool Chip8Runtime::load(){
+    if (!chip8.loadROM(program.rom, program.rom_size))
+        return false;
+    rebuild();
+    return true;
+}
+
+/**
+ * Enables the blocks whose bytes in memory still match the ROM image they
+ * were generated from, and disables the others. Runs whenever all of
+ * memory is replaced, as by Chip8::loadState.
+ */
+void Chip8Runtime::rebuild(){
+    std::fill(std::begin(table), std::end(table), nullptr);
+    std::fill(std::begin(code_map), std::end(code_map), false);
+    for (std::size_t i = 0; i < program.block_count; ++i) {
+        const RecompiledBlock& block = program.blocks[i];
+        if (block.start < start_addr || block.end > start_addr + program.rom_size
+                || memcmp(memory + block.start, program.rom + (block.start - start_addr), block.end - block.start) != 0)
+            continue;
+        table[block.start] = &block;
+        std::fill(code_map + block.start, code_map + block.end, true);
+    }
+}
+
+/**
+ * Emulates the given number of cycles, running generated blocks where
+ * available and the interpreter for everything else.
+ */
+void Chip8Runtime::run(uint32_t cycles){
+    while (cycles) {
+        const RecompiledBlock* block = (pc <= mem_mask) ? table[pc] : nullptr;
+        if (block && block->length <= cycles) {
+            block->code(*this);
+            cycles -= block->length;
+        } else {
+            chip8.emulateCycle();
+            --cycles;
+        }
+    }
+}
+
+/**
+ * Executes one instruction with the interpreter's handler. Generated code
+ * uses this for instructions it does not translate itself; pc must already
+ * point past the instruction.
+ */
+void Chip8Runtime::execute(uint16_t instruction){
+    Instruction decoded = decode(instruction);
+    Chip8::op_handlers[static_cast<uint8_t>(decoded.op)](chip8, decoded);
+}
+
+/**
+ * Disables the generated blocks covering written bytes, so self-modified
+ * code runs in the interpreter. A write covering all of memory rebuilds the
+ * table from the new contents instead.
+ */
+void Chip8Runtime::on_write(uint16_t addr, uint16_t len){
+    if (len >= mem_size) {
+        rebuild();
+        return;
+    }
+    for (uint16_t i = 0; i < len; ++i) {
+        uint16_t written = (addr + i) & mem_mask;
+        if (!code_map[written])
+            continue;
+        uint16_t first = written >= 2 * block_max_length ? written - 2 * block_max_length : 0;
+        for (uint16_t start = first; start <= written; ++start) {
+            if (table[start] && written < table[start]->end) {
+                table[start] = nullptr;
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "chip8.h"
+
+class Chip8Runtime;
+
+// A block of a ROM translated to C++ by chip8-recomp.
+struct RecompiledBlock {
+    uint16_t start;                    //address of the first instruction
+    uint16_t end;                      //address past the last instruction
+    uint8_t length;                    //instructions executed per call
+    void (*code)(Chip8Runtime&);
+};
+
+// Everything chip8-recomp emits for one ROM.
+struct RecompiledProgram {
+    const uint8_t* rom;
+    std::size_t rom_size;
+    const RecompiledBlock* blocks;
+    std::size_t block_count;
+};
+
+/**
+ * Runs a recompiled ROM on a Chip8 machine.
+ *
+ * Generated blocks operate directly on the machine state exposed here.
+ * Addresses without a generated block (code reached through Bnnn or
+ * otherwise not found by the recompiler) and blocks whose bytes have been
+ * overwritten run in the interpreter instead.
+ */
+class Chip8Runtime {
+public:
+    Chip8Runtime(Chip8& chip8, const RecompiledProgram& program);
+    ~Chip8Runtime();
+    Chip8Runtime(const Chip8Runtime&) = delete;
+    Chip8Runtime& operator=(const Chip8Runtime&) = delete;
+
+    bool load();
+    void run(uint32_t cycles);
+    void execute(uint16_t instruction);
+
+    uint8_t (&V)[16];
+    uint16_t& I;
+    uint16_t& pc;
+    uint8_t& sp;
+    uint16_t (&stack)[stack_size];
+    uint8_t& delay_timer;
+    uint8_t& sound_timer;
+    uint8_t (&memory)[mem_size];
+private:
+    void on_write(uint16_t addr, uint16_t len);
+    void rebuild();
+
+    Chip8& chip8;
+    const RecompiledProgram& program;
+    const RecompiledBlock* table[mem_size] = {};   //block starting at each address
+    bool code_map[mem_size] = {};                  //bytes covered by any block
+};
@@ -1,6 +1,10 @@
 #include "renderer.h"
 
-bool Renderer::init_renderer(){ 
+/**
+ * Initializes SDL and opens the window. Events for the window must be
+ * handled on the thread calling this.
+ */
+bool Renderer::init_window(){
     if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
         std::cerr << "Failed to initialize SDL: " << SDL_GetError() << std::endl;
         return false;
@@ -19,12 +23,22 @@ bool Renderer::init_renderer(){
         SDL_Quit();
         return false;
     }
+    return true;
+}
+
+/**
+ * Creates the SDL renderer and the display texture, opening the window
+ * first if init_window has not been called. Everything drawing through them
+ * must run on the thread calling this.
+ */
+bool Renderer::init_renderer(bool vsync){ 
+    if (!window && !init_window())
+        return false;
 
-    renderer = SDL_CreateRenderer(window, -1, 0);
+    renderer = SDL_CreateRenderer(window, -1, vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
     if (!renderer) {
         std::cerr << "Failed to create SDL renderer: " << SDL_GetError() << std::endl;
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+        clean_renderer();
         return false;
     }
 
@@ -32,39 +46,84 @@ bool Renderer::init_renderer(){
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 64, 32);
     if (!texture) {
         std::cerr << "SDL_CreateTexture Error: " << SDL_GetError() << std::endl;
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
+        clean_renderer();
         return false;
     }
-
+    stale = true;
     return true;
 }
 
-void Renderer::clean_renderer(){
+// Releases the SDL renderer and texture, on the thread that created them.
+void Renderer::destroy_renderer(){
+    if (texture) {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
     if (renderer) {
         SDL_DestroyRenderer(renderer);
         renderer = nullptr;
     }
+}
+
+void Renderer::clean_renderer(){
+    destroy_renderer();
     if (window) {
         SDL_DestroyWindow(window);
         window = nullptr;
+        SDL_Quit(); 
     }
-    if (texture) {
-        SDL_DestroyTexture(texture);
-        texture = nullptr;
-    }
-    SDL_Quit(); 
 }
 
-void Renderer::render_frame(uint8_t (&display) [CHIP8_WIDTH * CHIP8_HEIGHT]){
-    uint32_t pixels[CHIP8_WIDTH * CHIP8_HEIGHT];
-    for (int i = 0; i < CHIP8_WIDTH * CHIP8_HEIGHT; i++) {
-        pixels[i] = (display[i] == 1) ? 0xFFFFFFFF : 0x00000000;
-    }
+void Renderer::set_palette(Palette palette){
+    this->palette = palette;
+    stale = true;
+}
+
+/**
+ * Renders a whole display stored as Chip8::display, one 64-bit word per
+ * row with bit 63 leftmost, and presents it.
+ */
+void Renderer::render_frame(const uint64_t (&display) [CHIP8_HEIGHT]){
+    upload_rows(display, ~0u);
+    present();
+}
 
-    SDL_UpdateTexture(texture, nullptr, pixels, CHIP8_WIDTH * sizeof(uint32_t));
+/**
+ * Uploads the rows set in dirty_rows to the texture without presenting.
+ *
+ * Each run of adjacent dirty rows is expanded into its own locked
+ * sub-rectangle of the texture; the other rows keep what the previous
+ * frames left there.
+ */
+void Renderer::upload_rows(const uint64_t (&display) [CHIP8_HEIGHT], uint32_t dirty_rows){
+    if (stale) {
+        dirty_rows = ~0u;
+        stale = false;
+    }
+    int y = 0;
+    while (y < CHIP8_HEIGHT) {
+        if (!(dirty_rows & (1u << y))) {
+            ++y;
+            continue;
+        }
+        int first = y;
+        while (y < CHIP8_HEIGHT && (dirty_rows & (1u << y))) {
+            ++y;
+        }
+        SDL_Rect rect = {0, first, CHIP8_WIDTH, y - first};
+        void* pixels = nullptr;
+        int pitch = 0;
+        if (SDL_LockTexture(texture, &rect, &pixels, &pitch) < 0) {
+            std::cerr << "SDL_LockTexture Error: " << SDL_GetError() << std::endl;
+            stale = true;
+            return;
+        }
+        best_pixel_expander().expand_rows(display + first, y - first, static_cast<uint32_t*>(pixels), pitch, palette);
+        SDL_UnlockTexture(texture);
+    }
+}
 
+void Renderer::present(){
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <SDL2/SDL.h>
 
+#include "pixelexpander.h"
+
 constexpr uint8_t CHIP8_WIDTH = 64;
 constexpr uint8_t CHIP8_HEIGHT = 32;
 constexpr uint8_t SCALER = 10;
@@ -11,10 +13,18 @@ class Renderer {
 public:
     Renderer() =default;
     ~Renderer();
-    bool init_renderer();
+    bool init_window();
+    bool init_renderer(bool vsync = false);
+    void destroy_renderer();
     void clean_renderer();
-    void render_frame(uint8_t (&display) [CHIP8_WIDTH * CHIP8_HEIGHT]);
+    void render_frame(const uint64_t (&display) [CHIP8_HEIGHT]);
+    void upload_rows(const uint64_t (&display) [CHIP8_HEIGHT], uint32_t dirty_rows);
+    void present();
+    void set_palette(Palette palette);
 private:
+
+    Palette palette = palette_classic;
+    bool stale = true;  //the texture does not hold a full frame in the current palette
     SDL_Renderer* renderer = nullptr;
     SDL_Window* window = nullptr;
     SDL_Texture* texture = nullptr;
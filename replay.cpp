@@ -0,0 +1,169 @@
+#include "replay.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "crc32.h"
+
+namespace {
+
+constexpr uint8_t replay_magic[4] = {'C', '8', 'R', 'P'};
+constexpr std::size_t replay_header_size = sizeof(replay_magic) + 2 * 2 + 4 + 8 + 4 + 8 + 8 + 4 + 4;
+
+template <typename T>
+void put_le(std::vector<uint8_t>& out, T value){
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8 * i)));
+    }
+}
+
+template <typename T>
+T get_le(const uint8_t*& in){
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<uint64_t>(*in++) << (8 * i);
+    }
+    return static_cast<T>(value);
+}
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value){
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool get_varint(const uint8_t*& in, const uint8_t* end, uint64_t& value){
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+/**
+ * Adds an event for every key that changed since the last snapshot. cycle
+ * is the number of instructions run before the new keypad takes effect.
+ */
+void InputRecorder::record(const bool* keypad, uint64_t cycle){
+    for (uint8_t key = 0; key < 16; ++key) {
+        if (keypad[key] != last[key]) {
+            recorded.push_back({cycle, key, keypad[key]});
+            last[key] = keypad[key];
+        }
+    }
+}
+
+const std::vector<InputEvent>& InputRecorder::events() const{
+    return recorded;
+}
+
+/**
+ * Computes the CRC-32 of a ROM file, which identifies the ROM a replay was
+ * recorded with.
+ */
+bool rom_crc32(const char* path, uint32_t& crc){
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open ROM file." << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    crc = crc32(rom.data(), rom.size());
+    return true;
+}
+
+// CRC-32 of the machine's whole save state, to compare runs bit for bit.
+uint32_t state_crc32(const Chip8& chip8){
+    uint8_t state[state_size];
+    chip8.saveState(state);
+    return crc32(state, state_size);
+}
+
+bool save_replay(const char* path, const Replay& replay){
+    std::vector<uint8_t> data(replay_magic, replay_magic + sizeof(replay_magic));
+    put_le<uint16_t>(data, replay_version);
+    put_le<uint16_t>(data, 0);
+    put_le(data, replay.rom_crc);
+    put_le(data, replay.seed);
+    put_le(data, replay.ipf);
+    put_le(data, replay.cycles);
+    put_le(data, replay.framebuffer_hash);
+    put_le(data, replay.state_crc);
+    put_le(data, static_cast<uint32_t>(replay.events.size()));
+    uint64_t cycle = 0;
+    for (const InputEvent& event : replay.events) {
+        put_varint(data, event.cycle - cycle);
+        data.push_back(static_cast<uint8_t>(event.key | (event.pressed ? 0x80 : 0)));
+        cycle = event.cycle;
+    }
+    put_le(data, crc32(data.data(), data.size()));
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+        std::cerr << "Failed to write replay file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads a replay written by save_replay. Files of another version, or
+ * failing their CRC, are rejected.
+ */
+bool load_replay(const char* path, Replay& replay){
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open replay file " << path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < replay_header_size + 4 || memcmp(data.data(), replay_magic, sizeof(replay_magic)) != 0) {
+        std::cerr << "Not a replay file." << std::endl;
+        return false;
+    }
+    const uint8_t* end = data.data() + data.size() - 4;
+    const uint8_t* crc_in = end;
+    if (get_le<uint32_t>(crc_in) != crc32(data.data(), data.size() - 4)) {
+        std::cerr << "Replay file is corrupt." << std::endl;
+        return false;
+    }
+    const uint8_t* in = data.data() + sizeof(replay_magic);
+    if (get_le<uint16_t>(in) != replay_version) {
+        std::cerr << "Unsupported replay version." << std::endl;
+        return false;
+    }
+    get_le<uint16_t>(in);
+    replay.rom_crc = get_le<uint32_t>(in);
+    replay.seed = get_le<uint64_t>(in);
+    replay.ipf = get_le<uint32_t>(in);
+    replay.cycles = get_le<uint64_t>(in);
+    replay.framebuffer_hash = get_le<uint64_t>(in);
+    replay.state_crc = get_le<uint32_t>(in);
+    uint32_t count = get_le<uint32_t>(in);
+    replay.events.clear();
+    uint64_t cycle = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t delta;
+        if (!get_varint(in, end, delta) || in == end) {
+            std::cerr << "Replay file is corrupt." << std::endl;
+            return false;
+        }
+        cycle += delta;
+        uint8_t key = *in++;
+        replay.events.push_back({cycle, static_cast<uint8_t>(key & 0x0F), (key & 0x80) != 0});
+    }
+    if (in != end || replay.ipf == 0) {
+        std::cerr << "Replay file is corrupt." << std::endl;
+        return false;
+    }
+    return true;
+}
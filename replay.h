@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "inputscript.h"
+
+//replay file format: "C8RP", version, ROM CRC-32, seed, ipf, instruction
+//count, final framebuffer hash and save state CRC-32, then the events as a
+//varint cycle delta and a byte of key | pressed << 7, all little-endian,
+//followed by a CRC-32 of everything before it
+constexpr uint16_t replay_version = 1;
+
+// A session recorded from power-on, with what it takes to reproduce it.
+struct Replay {
+    uint32_t rom_crc = 0;
+    uint64_t seed = 0;
+    uint32_t ipf = 0;
+    uint64_t cycles = 0;            //instructions run in the session
+    uint64_t framebuffer_hash = 0;  //at the end, to check a replay against
+    uint32_t state_crc = 0;         //CRC-32 of the save state at the end
+    std::vector<InputEvent> events;
+};
+
+// Turns keypad snapshots taken between frames into transitions.
+class InputRecorder {
+public:
+    void record(const bool* keypad, uint64_t cycle);
+    const std::vector<InputEvent>& events() const;
+private:
+    bool last[16] = {};
+    std::vector<InputEvent> recorded;
+};
+
+bool rom_crc32(const char* path, uint32_t& crc);
+uint32_t state_crc32(const Chip8& chip8);
+bool save_replay(const char* path, const Replay& replay);
+bool load_replay(const char* path, Replay& replay);
@@ -0,0 +1,218 @@
+#include "rewind.h"
+
+#include <cstring>
+
+namespace {
+
+const uint8_t zero_state[state_size] = {};
+
+//zero runs shorter than this stay inside a literal run
+constexpr std::size_t min_zero_run = 4;
+
+void put_varint(uint8_t*& out, std::size_t value){
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+}
+
+std::size_t get_varint(const uint8_t*& in){
+    std::size_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+/**
+ * Run-length encodes state XOR reference as pairs of runs: a varint count
+ * of bytes equal to the reference, then a varint count of literal XOR
+ * bytes followed by those bytes. Returns the encoded size.
+ */
+std::size_t encode(const uint8_t* state, const uint8_t* reference, uint8_t* out){
+    uint8_t* start = out;
+    std::size_t i = 0;
+    while (i < state_size) {
+        std::size_t zeros = i;
+        while (i < state_size && state[i] == reference[i]) {
+            ++i;
+        }
+        zeros = i - zeros;
+        std::size_t literal = i;
+        while (i < state_size) {
+            if (state[i] == reference[i]) {
+                std::size_t run = 1;
+                while (run < min_zero_run && i + run < state_size && state[i + run] == reference[i + run]) {
+                    ++run;
+                }
+                if (run == min_zero_run || i + run == state_size)
+                    break;
+                i += run;
+                continue;
+            }
+            ++i;
+        }
+        put_varint(out, zeros);
+        put_varint(out, i - literal);
+        for (std::size_t j = literal; j < i; ++j) {
+            *out++ = state[j] ^ reference[j];
+        }
+    }
+    return out - start;
+}
+
+} // namespace
+
+/**
+ * Creates a buffer holding at most capacity bytes of encoded snapshots.
+ */
+RewindBuffer::RewindBuffer(std::size_t capacity, unsigned keyframe_interval):
+ring(capacity), keyframe_interval(keyframe_interval ? keyframe_interval : 1),
+scratch(2 * state_size + 16){}
+
+/**
+ * Records the current state of the machine as the newest snapshot.
+ */
+void RewindBuffer::push(const Chip8& chip8){
+    if (ring.empty())
+        return;
+    uint8_t state[state_size];
+    chip8.saveState(state);
+    bool key = !has_keyframe || since_keyframe + 1 >= keyframe_interval;
+    std::size_t size = encode(state, key ? zero_state : keyframe, scratch.data());
+    std::size_t offset;
+    if (!reserve(size, key, offset)) {
+        //the snapshot only fits once the keyframe it refers to is evicted
+        clear();
+        key = true;
+        size = encode(state, zero_state, scratch.data());
+        if (!reserve(size, key, offset))
+            return;
+    }
+    memcpy(ring.data() + offset, scratch.data(), size);
+    entries.push_back({offset, size, key});
+    head = offset + size;
+    used += size;
+    if (key) {
+        memcpy(keyframe, state, state_size);
+        has_keyframe = true;
+        ++keyframes;
+        since_keyframe = 0;
+    } else {
+        ++since_keyframe;
+    }
+}
+
+/**
+ * Restores the newest snapshot into the machine and drops it. Returns
+ * false if there is none left.
+ */
+bool RewindBuffer::pop(Chip8& chip8){
+    if (entries.empty())
+        return false;
+    Entry entry = entries.back();
+    uint8_t state[state_size];
+    decode(entry, entry.keyframe ? zero_state : keyframe, state);
+    entries.pop_back();
+    head = entry.offset;
+    used -= entry.size;
+    if (entry.keyframe) {
+        --keyframes;
+        restore_keyframe();
+    } else {
+        --since_keyframe;
+    }
+    return chip8.loadState(state, state_size);
+}
+
+void RewindBuffer::clear(){
+    entries.clear();
+    head = 0;
+    used = 0;
+    keyframes = 0;
+    since_keyframe = 0;
+    has_keyframe = false;
+}
+
+RewindStats RewindBuffer::stats() const{
+    RewindStats stats;
+    stats.frames = entries.size();
+    stats.bytes_used = used;
+    stats.capacity = ring.size();
+    if (used)
+        stats.compression_ratio = static_cast<double>(entries.size() * state_size) / used;
+    return stats;
+}
+
+/**
+ * Finds room for size bytes after the newest snapshot, wrapping to the
+ * start of the ring when the end is too short, and evicting the oldest
+ * keyframes with their snapshots from the space needed. A snapshot that is
+ * not a keyframe must not evict the newest keyframe.
+ */
+bool RewindBuffer::reserve(std::size_t size, bool keyframe, std::size_t& offset){
+    if (size > ring.size())
+        return false;
+    offset = head;
+    if (offset + size > ring.size()) {
+        //the snapshots left between head and the end go before wrapping
+        while (!entries.empty() && entries.front().offset >= head) {
+            if (!keyframe && keyframes == 1)
+                return false;
+            evict_oldest();
+        }
+        offset = 0;
+    }
+    while (!entries.empty()) {
+        std::size_t oldest = entries.front().offset;
+        //the oldest snapshot lies behind the write position, or far enough ahead
+        if (oldest < offset || oldest >= offset + size)
+            break;
+        if (!keyframe && keyframes == 1)
+            return false;
+        evict_oldest();
+    }
+    return true;
+}
+
+// Drops the oldest keyframe and the snapshots encoded against it.
+void RewindBuffer::evict_oldest(){
+    do {
+        used -= entries.front().size;
+        entries.pop_front();
+    } while (!entries.empty() && !entries.front().keyframe);
+    --keyframes;
+    if (entries.empty())
+        clear();
+}
+
+// Decodes the newest keyframe left after the previous one was popped.
+void RewindBuffer::restore_keyframe(){
+    since_keyframe = 0;
+    for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+        if (entry->keyframe) {
+            decode(*entry, zero_state, keyframe);
+            return;
+        }
+        ++since_keyframe;
+    }
+    has_keyframe = false;
+}
+
+void RewindBuffer::decode(const Entry& entry, const uint8_t* reference, uint8_t* state) const{
+    const uint8_t* in = ring.data() + entry.offset;
+    const uint8_t* end = in + entry.size;
+    std::size_t i = 0;
+    while (in < end) {
+        std::size_t zeros = get_varint(in);
+        memcpy(state + i, reference + i, zeros);
+        i += zeros;
+        std::size_t literal = get_varint(in);
+        for (std::size_t j = 0; j < literal; ++j, ++i) {
+            state[i] = reference[i] ^ *in++;
+        }
+    }
+}
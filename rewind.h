@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "chip8.h"
+
+struct RewindStats {
+    std::size_t frames = 0;         //snapshots held
+    std::size_t bytes_used = 0;     //encoded size of the snapshots held
+    std::size_t capacity = 0;
+    double compression_ratio = 0;   //raw state bytes per encoded byte
+};
+
+/**
+ * Per-frame history of machine states for stepping backwards.
+ *
+ * Snapshots go into one ring buffer allocated up front, so the memory
+ * used stays fixed. Every keyframe_interval-th snapshot is a keyframe;
+ * the others are stored as the XOR of their state with the previous
+ * keyframe, which is mostly zeros since memory and display barely change
+ * between frames. Both kinds are then run-length encoded. When the buffer
+ * is full, the oldest keyframe goes together with the snapshots encoded
+ * against it.
+ */
+class RewindBuffer {
+public:
+    explicit RewindBuffer(std::size_t capacity, unsigned keyframe_interval = 60);
+
+    void push(const Chip8& chip8);
+    bool pop(Chip8& chip8);
+    void clear();
+    RewindStats stats() const;
+private:
+    struct Entry {
+        std::size_t offset;
+        std::size_t size;
+        bool keyframe;
+    };
+
+    bool reserve(std::size_t size, bool keyframe, std::size_t& offset);
+    void evict_oldest();
+    void restore_keyframe();
+    void decode(const Entry& entry, const uint8_t* reference, uint8_t* state) const;
+
+    std::vector<uint8_t> ring;
+    std::deque<Entry> entries;
+    std::size_t head = 0;           //where the next snapshot is written
+    std::size_t used = 0;
+    std::size_t keyframes = 0;
+    unsigned keyframe_interval;
+    unsigned since_keyframe = 0;    //snapshots after the newest keyframe
+    bool has_keyframe = false;
+    uint8_t keyframe[state_size];   //state of the newest keyframe
+    std::vector<uint8_t> scratch;
+};
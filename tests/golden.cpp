@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "crc32.h"
+#include "inputscript.h"
+#include "workpool.h"
+
+constexpr uint32_t golden_ipf = 11;
+constexpr uint64_t golden_seed = 1;
+constexpr uint64_t golden_cycles = 500000;
+constexpr uint64_t checkpoint_interval = 50000;
+
+// Hashes at one checkpoint of one ROM.
+struct Checkpoint {
+    uint64_t framebuffer_hash;
+    uint64_t registers_hash;
+};
+
+using Goldens = std::map<std::pair<std::string, uint64_t>, Checkpoint>;
+
+static bool parse_backend(const char* name, Backend& backend){
+    if (strcmp(name, "interpreter") == 0) backend = Backend::Interpreter;
+    else if (strcmp(name, "blocks") == 0) backend = Backend::Blocks;
+    else if (strcmp(name, "jit") == 0) backend = Backend::Jit;
+    else return false;
+    return true;
+}
+
+// FNV-1a over the registers, stack included.
+static uint64_t registers_hash(const Chip8Registers& registers){
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&hash](uint64_t value, int bytes){
+        for (int i = 0; i < bytes; ++i) {
+            hash = (hash ^ ((value >> (8 * i)) & 0xFF)) * 0x100000001B3ull;
+        }
+    };
+    for (uint8_t value : registers.V) {
+        mix(value, 1);
+    }
+    mix(registers.I, 2);
+    mix(registers.pc, 2);
+    mix(registers.sp, 1);
+    mix(registers.delay_timer, 1);
+    mix(registers.sound_timer, 1);
+    for (uint16_t value : registers.stack) {
+        mix(value, 2);
+    }
+    return hash;
+}
+
+/**
+ * Key presses for a ROM: a key goes down, stays down for a few frames and
+ * goes up again, every few hundred to few thousand instructions. The
+ * sequence depends only on the ROM's name, so adding ROMs to the corpus
+ * leaves the inputs of the others unchanged.
+ */
+static std::vector<InputEvent> script_for(const std::string& name){
+    uint32_t state = crc32(reinterpret_cast<const uint8_t*>(name.data()), name.size()) | 1;
+    auto next = [&state](){
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    std::vector<InputEvent> events;
+    for (uint64_t cycle = 0; ; ) {
+        cycle += 200 + next() % 2000;
+        if (cycle >= golden_cycles)
+            break;
+        uint8_t key = next() % 16;
+        events.push_back({cycle, key, true});
+        events.push_back({cycle + golden_ipf * (1 + next() % 8), key, false});
+    }
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b){
+        return a.cycle < b.cycle;
+    });
+    return events;
+}
+
+static bool load_goldens(const char* path, Goldens& goldens){
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open golden file " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string rom, cycle, framebuffer, registers;
+        std::getline(fields, rom, '\t');
+        std::getline(fields, cycle, '\t');
+        std::getline(fields, framebuffer, '\t');
+        std::getline(fields, registers, '\t');
+        if (rom.empty() || registers.empty()) {
+            std::cerr << path << ":" << number << ": expected \"<rom>\\t<cycle>\\t<framebuffer>\\t<registers>\"" << std::endl;
+            return false;
+        }
+        goldens[{rom, strtoull(cycle.c_str(), nullptr, 10)}] = {
+            strtoull(framebuffer.c_str(), nullptr, 16), strtoull(registers.c_str(), nullptr, 16)};
+    }
+    return true;
+}
+
+static bool save_goldens(const char* path, const Goldens& goldens){
+    std::ofstream file(path);
+    file << "# <rom>\t<cycle>\t<framebuffer hash>\t<registers hash>, written by chip8-golden --update\n";
+    file << std::hex << std::setfill('0');
+    for (const auto& golden : goldens) {
+        file << golden.first.first << '\t' << std::dec << golden.first.second << std::hex
+             << '\t' << std::setw(16) << golden.second.framebuffer_hash
+             << '\t' << std::setw(16) << golden.second.registers_hash << '\n';
+    }
+    if (!file) {
+        std::cerr << "Failed to write golden file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char* name){
+    std::cerr << "Usage: " << name << " [--backend interpreter|blocks|jit] [--threads N] [--update]"
+              << " <rom_directory> <golden_file>" << std::endl;
+}
+
+/**
+ * Regression test over a ROM corpus.
+ *
+ * Every .ch8 under the directory runs for a fixed number of instructions
+ * with a fixed seed and scripted key presses, and the framebuffer and
+ * registers are hashed at regular checkpoints. The hashes are compared
+ * with the golden file, or written to it with --update. ROMs run in
+ * parallel on all cores.
+ */
+int main(int argc, char* argv[]){
+    const char* rom_directory = nullptr;
+    const char* golden_path = nullptr;
+    Backend backend = Backend::Interpreter;
+    unsigned threads = 0;
+    bool update = false;
+    for (int i = 1; i < argc; ++i) {
+        bool ok = true;
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            ok = parse_backend(argv[++i], backend);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (!rom_directory) {
+            rom_directory = argv[i];
+        } else if (!golden_path) {
+            golden_path = argv[i];
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!golden_path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(rom_directory, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".ch8")
+            roms.push_back(std::filesystem::relative(entry.path(), rom_directory).generic_string());
+    }
+    if (error) {
+        std::cerr << "Failed to read ROM directory " << rom_directory << std::endl;
+        return 1;
+    }
+    std::sort(roms.begin(), roms.end());
+
+    //reject a backend this build lacks before running any ROM
+    if (!Chip8().set_backend(backend))
+        return 1;
+
+    std::vector<std::vector<Checkpoint>> results(roms.size());
+    std::vector<char> loaded(roms.size(), 0);
+    WorkStealingPool pool(threads);
+    pool.run(roms.size(), [&](std::size_t index, unsigned){
+        Chip8 chip8;
+        if (!chip8.loadROM((std::filesystem::path(rom_directory) / roms[index]).string().c_str()))
+            return;
+        loaded[index] = 1;
+        chip8.set_backend(backend);
+        chip8.seed(golden_seed);
+        std::vector<InputEvent> events = script_for(roms[index]);
+        ScriptedRun run(chip8, events, golden_ipf);
+        while (run.cycles() < golden_cycles) {
+            run.run(checkpoint_interval);
+            results[index].push_back({chip8.framebuffer_hash(), registers_hash(chip8.registers())});
+        }
+    });
+
+    Goldens actual;
+    for (std::size_t index = 0; index < roms.size(); ++index) {
+        for (std::size_t checkpoint = 0; checkpoint < results[index].size(); ++checkpoint) {
+            actual[{roms[index], (checkpoint + 1) * checkpoint_interval}] = results[index][checkpoint];
+        }
+    }
+    if (update) {
+        if (!save_goldens(golden_path, actual))
+            return 1;
+        std::cout << "Wrote " << actual.size() << " checkpoints of " << roms.size() << " ROMs to " << golden_path << std::endl;
+        return 0;
+    }
+
+    Goldens expected;
+    if (!load_goldens(golden_path, expected))
+        return 1;
+    std::size_t failures = 0;
+    for (std::size_t index = 0; index < roms.size(); ++index) {
+        if (!loaded[index]) {
+            std::cout << "FAIL " << roms[index] << ": could not be loaded" << std::endl;
+            ++failures;
+        }
+    }
+    //report only the first checkpoint where a ROM diverges
+    std::string failed_rom;
+    for (const auto& golden : expected) {
+        const std::string& rom = golden.first.first;
+        auto result = actual.find(golden.first);
+        if (rom == failed_rom)
+            continue;
+        if (result == actual.end()) {
+            if (std::binary_search(roms.begin(), roms.end(), rom))
+                continue;   //already reported as not loaded
+            std::cout << "FAIL " << rom << ": missing from the corpus" << std::endl;
+        } else if (result->second.framebuffer_hash != golden.second.framebuffer_hash
+                || result->second.registers_hash != golden.second.registers_hash) {
+            std::cout << "FAIL " << rom << ": "
+                      << (result->second.framebuffer_hash != golden.second.framebuffer_hash ? "framebuffer" : "registers")
+                      << " differ at cycle " << golden.first.second << std::endl;
+        } else {
+            continue;
+        }
+        failed_rom = rom;
+        ++failures;
+    }
+    for (const auto& result : actual) {
+        if (!expected.count(result.first) && result.first.first != failed_rom) {
+            std::cout << "FAIL " << result.first.first << ": no golden values" << std::endl;
+            failed_rom = result.first.first;
+            ++failures;
+        }
+    }
+    std::cout << roms.size() << " ROMs, " << actual.size() << " checkpoints, " << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+#include <cstring>
+#include <iostream>
+
+#include "chip8.h"
+
+constexpr uint32_t check_ipf = 11;
+constexpr uint64_t check_seed = 1;
+constexpr uint32_t check_frames = 5000;
+constexpr int skip_status = 77;     //SKIP_RETURN_CODE of the test
+
+static bool same_registers(const Chip8Registers& a, const Chip8Registers& b){
+    return memcmp(a.V, b.V, sizeof(a.V)) == 0 && a.I == b.I && a.pc == b.pc && a.sp == b.sp
+        && a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer
+        && memcmp(a.stack, b.stack, sizeof(a.stack)) == 0;
+}
+
+/**
+ * Runs the ROM with the JIT on a code buffer of the given size next to the
+ * interpreter and checks that both end every frame in the same state, and
+ * that the JIT is still the active backend only if it should be.
+ */
+static bool check(const char* rom, std::size_t buffer_size, Backend expected){
+    Chip8 jit;
+    Chip8 interpreted;
+    if (!jit.loadROM(rom) || !interpreted.loadROM(rom))
+        return false;
+    jit.set_backend(Backend::Jit);
+    jit.set_jit_buffer_size(buffer_size);
+    jit.seed(check_seed);
+    interpreted.seed(check_seed);
+    for (uint32_t frame = 0; frame < check_frames; ++frame) {
+        jit.run(check_ipf);
+        interpreted.run(check_ipf);
+        jit.update_timers();
+        interpreted.update_timers();
+        if (jit.framebuffer_hash() != interpreted.framebuffer_hash()
+                || !same_registers(jit.registers(), interpreted.registers())) {
+            std::cout << "FAIL: " << buffer_size << "-byte buffer differs from the interpreter at frame "
+                      << frame << std::endl;
+            return false;
+        }
+    }
+    if (jit.active_backend() != expected) {
+        std::cout << "FAIL: " << buffer_size << "-byte buffer "
+                  << (expected == Backend::Jit ? "left" : "kept") << " the JIT" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Forces CodeBuffer::install to fail: with no buffer at all the machine
+ * must switch to the interpreter, and with a buffer too small for some
+ * blocks it must interpret those and keep the JIT for the rest.
+ */
+int main(int argc, char* argv[]){
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <path_to_rom>" << std::endl;
+        return 1;
+    }
+    if (!Chip8().set_backend(Backend::Jit))
+        return skip_status;
+    if (!check(argv[1], 0, Backend::Interpreter) || !check(argv[1], 64, Backend::Jit))
+        return 1;
+    std::cout << "JIT falls back to the interpreter when its code buffer fails" << std::endl;
+    return 0;
+}
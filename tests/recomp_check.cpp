@@ -0,0 +1,80 @@
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "chip8.h"
+#include "recomp_runtime.h"
+
+extern const RecompiledProgram chip8_recompiled_program;
+
+constexpr uint32_t check_ipf = 11;
+constexpr uint64_t check_seed = 1;
+constexpr uint32_t check_frames = 20000;
+constexpr uint32_t key_interval = 30;      //frames between keypad changes
+
+static bool same_registers(const Chip8Registers& a, const Chip8Registers& b){
+    return memcmp(a.V, b.V, sizeof(a.V)) == 0 && a.I == b.I && a.pc == b.pc && a.sp == b.sp
+        && a.delay_timer == b.delay_timer && a.sound_timer == b.sound_timer
+        && memcmp(a.stack, b.stack, sizeof(a.stack)) == 0;
+}
+
+/**
+ * Runs the ROM linked in by chip8-recomp through Chip8Runtime and the same
+ * ROM through the interpreter, frame by frame with the same seed and key
+ * presses, and fails at the first frame where the framebuffer or the
+ * registers differ. Halfway through, both load a state whose memory holds
+ * a patched copy of the ROM, which the generated blocks must not run.
+ */
+int main(){
+    Chip8 recompiled;
+    Chip8Runtime runtime(recompiled, chip8_recompiled_program);
+    Chip8 interpreted;
+    if (!runtime.load() || !interpreted.loadROM(chip8_recompiled_program.rom, chip8_recompiled_program.rom_size)) {
+        std::cerr << "Failed to load the recompiled ROM" << std::endl;
+        return 1;
+    }
+    recompiled.seed(check_seed);
+    interpreted.seed(check_seed);
+
+    //every other byte changed, so most instructions get other operands
+    std::vector<uint8_t> patched(chip8_recompiled_program.rom, chip8_recompiled_program.rom + chip8_recompiled_program.rom_size);
+    for (std::size_t i = 1; i < patched.size(); i += 2) {
+        ++patched[i];
+    }
+    Chip8 patched_machine;
+    patched_machine.loadROM(patched.data(), patched.size());
+    patched_machine.seed(check_seed);
+    uint8_t patched_state[state_size];
+    patched_machine.saveState(patched_state);
+
+    uint32_t keys = 1;
+    for (uint32_t frame = 0; frame < check_frames; ++frame) {
+        if (frame == check_frames / 2
+                && (!recompiled.loadState(patched_state, state_size) || !interpreted.loadState(patched_state, state_size))) {
+            std::cerr << "Failed to load the patched state" << std::endl;
+            return 1;
+        }
+        if (frame % key_interval == 0) {
+            keys ^= keys << 13;
+            keys ^= keys >> 17;
+            keys ^= keys << 5;
+            for (int key = 0; key < 16; ++key) {
+                bool pressed = (keys >> key) & (keys >> (key + 16)) & 1;   //a quarter of the keys down
+                recompiled.keypad[key] = pressed;
+                interpreted.keypad[key] = pressed;
+            }
+        }
+        runtime.run(check_ipf);
+        interpreted.run(check_ipf);
+        recompiled.update_timers();
+        interpreted.update_timers();
+        bool framebuffer = recompiled.framebuffer_hash() == interpreted.framebuffer_hash();
+        if (!framebuffer || !same_registers(recompiled.registers(), interpreted.registers())) {
+            std::cout << "FAIL: " << (framebuffer ? "registers" : "framebuffer")
+                      << " differ from the interpreter at frame " << frame << std::endl;
+            return 1;
+        }
+    }
+    std::cout << check_frames << " frames match the interpreter" << std::endl;
+    return 0;
+}
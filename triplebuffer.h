@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free single-producer single-consumer triple buffer.
+ *
+ * The writer fills back() and publishes it by swapping it with the middle
+ * buffer; the reader takes the middle buffer in update() whenever a newer
+ * one has been published. Neither side ever waits for the other, and the
+ * reader always sees the most recently published value, so values
+ * published in between are skipped.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    //writer side
+    T& back(){
+        return buffers[back_index];
+    }
+
+    void publish(){
+        back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    //reader side, returns false if nothing was published since the last update
+    bool update(){
+        if (!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    const T& front() const{
+        return buffers[front_index];
+    }
+
+private:
+    static constexpr uint8_t index_mask = 0x3;
+    static constexpr uint8_t fresh = 0x4;     //set while the middle buffer is unread
+
+    T buffers[3] = {};
+    std::atomic<uint8_t> middle{1};
+    uint8_t back_index = 0;
+    uint8_t front_index = 2;
+};
@@ -0,0 +1,108 @@
+#include "workpool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned workers){
+    if (workers == 0)
+        workers = std::thread::hardware_concurrency();
+    if (workers == 0)
+        workers = 1;
+    for (unsigned i = 0; i < workers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 1; i < workers; ++i) {
+        threads.emplace_back([this, i]{ worker_loop(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned WorkStealingPool::size() const{
+    return static_cast<unsigned>(queues.size());
+}
+
+/**
+ * Calls task once for every index below count, spread over the workers,
+ * and returns when all calls have finished. Calls running at the same time
+ * always have different worker numbers, so the task can keep per-worker
+ * state indexed by them.
+ */
+void WorkStealingPool::run(std::size_t count, const Task& task){
+    if (count == 0)
+        return;
+    std::size_t workers = queues.size();
+    for (std::size_t i = 0; i < workers; ++i) {
+        std::lock_guard<std::mutex> lock(queues[i]->mutex);
+        for (std::size_t index = i * count / workers; index < (i + 1) * count / workers; ++index) {
+            queues[i]->indices.push_back(index);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        active = static_cast<unsigned>(threads.size());
+        ++generation;
+    }
+    wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]{ return active == 0; });
+    this->task = nullptr;
+}
+
+void WorkStealingPool::worker_loop(unsigned worker){
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        work(worker);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active == 0)
+            finished.notify_one();
+    }
+}
+
+void WorkStealingPool::work(unsigned worker){
+    std::size_t index;
+    while (take(worker, index)) {
+        (*task)(index, worker);
+    }
+}
+
+/**
+ * Takes the next index for a worker: the newest one of its own queue, or
+ * else the oldest one of the first other queue that has any left.
+ */
+bool WorkStealingPool::take(unsigned worker, std::size_t& index){
+    {
+        Queue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.indices.empty()) {
+            index = own.indices.back();
+            own.indices.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+        Queue& victim = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.indices.empty()) {
+            index = victim.indices.front();
+            victim.indices.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
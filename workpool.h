@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads running parallel loops with work stealing.
+ *
+ * run splits the indices of a loop into one contiguous queue per worker.
+ * Each worker takes indices from the back of its own queue, and once that
+ * is empty steals from the front of the others, so slow items do not leave
+ * the remaining workers idle. The calling thread works as worker 0.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void(std::size_t index, unsigned worker)>;
+
+    explicit WorkStealingPool(unsigned workers = 0);   //0 for one per hardware thread
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const;
+    void run(std::size_t count, const Task& task);
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> indices;
+    };
+
+    void worker_loop(unsigned worker);
+    void work(unsigned worker);
+    bool take(unsigned worker, std::size_t& index);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const Task* task = nullptr;
+    uint64_t generation = 0;    //bumped by every run
+    unsigned active = 0;        //helper threads still working on this run
+    bool stopping = false;
+};